@@ -11,13 +11,25 @@
  * license.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <math.h>
 #include <cairo-xlib.h>
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
 #include <X11/Xatom.h>
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
 
 #include "greeterbackground.h"
 #include "greeterdeprecated.h"
@@ -33,12 +45,25 @@ typedef enum
     /* Solid color */
     BACKGROUND_TYPE_COLOR,
     /* Path to image and scaling mode */
-    BACKGROUND_TYPE_IMAGE
-    /* Maybe other types (e.g. gradient) */
+    BACKGROUND_TYPE_IMAGE,
+    /* Linear or radial gradient, rendered for each monitor size */
+    BACKGROUND_TYPE_GRADIENT
 } BackgroundType;
 
 static const gchar* BACKGROUND_TYPE_SKIP_VALUE = "#skip";
 static const gchar* BACKGROUND_TYPE_DEFAULT_VALUE = "#default";
+static const gchar* GRADIENT_DITHERED_PREFIX = "#dithered:";
+static const gchar* GRADIENT_LINEAR_PREFIX = "linear-gradient(";
+static const gchar* GRADIENT_RADIAL_PREFIX = "radial-gradient(";
+/* Size of noise tile added to dithered gradients */
+static const gint GRADIENT_NOISE_SIZE = 64;
+
+typedef struct
+{
+    /* 0.0 - 1.0 */
+    gdouble offset;
+    GdkRGBA color;
+} GradientStop;
 
 typedef enum
 {
@@ -67,6 +92,15 @@ typedef struct
             gchar *path;
             ScalingMode mode;
         } image;
+        struct
+        {
+            gboolean radial;
+            /* Direction of linear gradient, CSS-like: 0 is to top, 90 is to right */
+            gdouble angle;
+            gboolean dithered;
+            guint n_stops;
+            GradientStop* stops;
+        } gradient;
     } options;
 } BackgroundConfig;
 
@@ -87,6 +121,9 @@ typedef struct
     BackgroundConfig bg;
     gboolean user_bg;
     gboolean laptop;
+    /* Effects applied to image backgrounds once, after scaling: blur radius in pixels, dimming in percents */
+    gint blur;
+    gint dim;
 
     TransitionConfig transition;
 } MonitorConfig;
@@ -99,7 +136,8 @@ typedef struct
     BackgroundType type;
     union
     {
-        GdkPixbuf* image;
+        /* Ready to paint surface, server-side when possible */
+        cairo_surface_t* image;
         GdkRGBA color;
     } options;
 } Background;
@@ -110,6 +148,9 @@ typedef struct
     gint number;
     gchar* name;
     GdkRectangle geometry;
+    gint scale;
+    /* Config used to create monitor window, NULL for skipped monitors */
+    const MonitorConfig* config;
     GtkWindow* window;
     gulong window_draw_handler_id;
 
@@ -119,6 +160,10 @@ typedef struct
      * Monitors with type = BACKGROUND_TYPE_SKIP have background = NULL */
     Background* background;
 
+    /* In-flight image loading jobs, cancelled when superseded */
+    GCancellable* loading_configured;
+    GCancellable* loading_custom;
+
     struct
     {
         TransitionConfig config;
@@ -132,11 +177,92 @@ typedef struct
         gint64 started;
         /* Current stage */
         gdouble stage;
+
+        /* Frames statistics, reported with debug messages */
+        guint frames;
+        gint64 last_frame;
+        gint64 max_frame_interval;
     } transition;
+
+    /* Area exposed since last paint statistics report, see greeter_background_set_paint_stats() */
+    guint64 painted_pixels;
+    guint painted_frames;
 } Monitor;
 
 static const Monitor INVALID_MONITOR_STRUCT = {0};
 
+/* Images shared between loading jobs, kept for whole greeter lifetime:
+   "path\n@WxH" => source <GdkPixbuf*> decoded to cover WxH, "path\nmode WxH scaler" => scaled <GdkPixbuf*> */
+typedef struct
+{
+    gchar* key;
+    GdkPixbuf* image;
+    gsize size;
+} ImagesCacheEntry;
+
+typedef struct
+{
+    /* Protects lookups and inserts only, images are decoded without it */
+    GMutex lock;
+    /* key => <ImagesCacheEntry*> */
+    GHashTable* table;
+    /* Keys of sources being decoded <gchar*>, other jobs wait for them on "loaded" */
+    GHashTable* loading;
+    GCond loaded;
+    /* <ImagesCacheEntry*>, most recently used first */
+    GQueue lru;
+    /* Total size of images, in bytes */
+    gsize size;
+    gsize limit;
+    guint hits;
+    guint misses;
+    guint evictions;
+} ImagesCache;
+
+/* Image background loading job, image is decoded and scaled in worker thread */
+typedef struct
+{
+    /* Must be used in main thread only */
+    Monitor* monitor;
+    BackgroundConfig config;
+    gint width;
+    gint height;
+    gint scale;
+    /* Source image is decoded at smallest size covering this area */
+    gint cover_width;
+    gint cover_height;
+    BackgroundScaler scaler;
+    /* Loading custom (user) background or configured one */
+    gboolean custom;
+    /* See MonitorConfig */
+    gint blur;
+    gint dim;
+
+    /* BACKGROUND_SCALER_RENDER: worker returns unscaled source, it is scaled by X server */
+    gchar* source_key;
+    /* Key in prefetch_jobs, NULL for jobs that set background */
+    gchar* prefetch_key;
+    /* CPU scaled image to compare with X server scaling result */
+    gboolean render_check;
+    cairo_surface_t* render_reference;
+} BackgroundLoad;
+
+/* On-disk cache of scaled images, file layout:
+   <DiskCacheHeader> <key> <padding to 16 bytes> <premultiplied cairo image data> */
+typedef struct
+{
+    guint32 magic;
+    guint32 key_length;
+    gint32 format;
+    gint32 width;
+    gint32 height;
+    gint32 stride;
+    guint32 reserved[2];
+} DiskCacheHeader;
+
+static const guint32 DISK_CACHE_MAGIC = 0x4742474c; /* "LGBG" */
+static const gchar* DISK_CACHE_SUFFIX = ".bgcache";
+
 struct _GreeterBackground
 {
     GObject parent_instance;
@@ -157,6 +283,10 @@ struct _GreeterBackgroundPrivate
 
     /* Widget to display on active monitor */
     GtkWidget* child;
+    /* Separate toplevel for child, moved to active monitor instead of reparenting child.
+       NULL if child is added to active monitor window */
+    GtkWindow* child_window;
+    gboolean child_window_enabled;
     /* List of groups <GtkAccelGroup*> for greeter screens windows */
     GSList* accel_groups;
 
@@ -165,28 +295,75 @@ struct _GreeterBackgroundPrivate
 
     /* Default config for unlisted monitors */
     MonitorConfig* default_config;
+    /* Replaced configs <MonitorConfig*>, still used by monitors until next greeter_background_connect() */
+    GSList* retired_configs;
 
-    /* Array of configured monitors for current screen */
-    Monitor* monitors;
+    /* Array of configured monitors <Monitor*> for current screen,
+       monitors are kept between reconfigurations if possible */
+    Monitor** monitors;
     gsize monitors_size;
 
     /* Name => <Monitor*>, "Number" => <Monitor*> */
     GHashTable* monitors_map;
 
+    /* Bursts of "monitors-changed" signals are merged into one reconfiguration */
+    guint monitors_settle_delay;
+    guint monitors_settle_id;
+    /* Signals received since last reconfiguration */
+    guint monitors_changes_pending;
+    /* Total number of reconfigurations avoided by merging */
+    guint monitors_changes_avoided;
+
+    /* Periodic report of painted pixels, 0 if disabled */
+    guint paint_stats_id;
+
     GList* active_monitors_config;
     const Monitor* active_monitor;
     gboolean active_monitor_change_in_progress;
-    gint64 active_monitor_change_last_timestamp;
+    /* Monitor entered by cursor, it becomes active if cursor stays on it for ACTIVE_MONITOR_DWELL_TIME */
+    const Monitor* active_monitor_candidate;
+    guint active_monitor_dwell_id;
 
     /* List of monitors <Monitor*> with user-background=true*/
     GSList* customized_monitors;
     /* Initialized by set_custom_background() */
     BackgroundConfig customized_background;
 
+    /* Shared by image loading jobs */
+    ImagesCache images_cache;
+    /* Largest monitor size, sources are not decoded beyond it */
+    gint images_cover_width;
+    gint images_cover_height;
+    BackgroundScaler images_scaler;
+    /* Sources uploaded for BACKGROUND_SCALER_RENDER: source key => <cairo_surface_t*>,
+       shared by monitors while loading jobs are running */
+    GHashTable* render_sources;
+    guint render_jobs;
+    /* X server scaling was compared with CPU scaling, see compare_render_scaling() */
+    gboolean render_checked;
+    /* Job with render_check is queued, cleared when it is done or cancelled */
+    gboolean render_check_running;
+
+    /* Prefetch jobs in flight: "value\nWxH blur dim" => <GTask*>, cancelled by greeter_background_cancel_prefetch() */
+    GHashTable* prefetch_jobs;
+    GCancellable* prefetch_cancellable;
+
+    /* Resolved image variants: "path\nWxH" => <gchar*> file path, filled by loading jobs.
+       Directories are scanned once per greeter_background_connect() */
+    GHashTable* image_variants;
+    GMutex image_variants_lock;
+
+    /* Directory of persistent scaled images cache, NULL if disabled */
+    gchar* disk_cache_dir;
+    /* Maximum size of disk cache, in bytes */
+    gsize disk_cache_limit;
+
     /* List of monitors <Monitor*> with laptop=true */
     GSList* laptop_monitors;
     /* DBus proxy to catch lid state changing */
     GDBusProxy* laptop_upower_proxy;
+    /* Proxy creation in progress, lid is considered open until it is done */
+    GCancellable* laptop_upower_cancellable;
     /* Cached lid state */
     gboolean laptop_lid_closed;
 
@@ -211,6 +388,8 @@ static const gchar* DBUS_UPOWER_PROP_LID_IS_PRESENT = "LidIsPresent";
 static const gchar* DBUS_UPOWER_PROP_LID_IS_CLOSED  = "LidIsClosed";
 
 static const gchar* ACTIVE_MONITOR_CURSOR_TAG       = "#cursor";
+/* Time (ms) cursor must stay on another monitor to make it active */
+static const guint  ACTIVE_MONITOR_DWELL_TIME       = 150;
 
 G_DEFINE_TYPE_WITH_PRIVATE(GreeterBackground, greeter_background, G_TYPE_OBJECT);
 
@@ -225,8 +404,28 @@ static void greeter_background_get_cursor_position  (GreeterBackground* backgrou
                                                      gint* x, gint* y);
 static void greeter_background_set_cursor_position  (GreeterBackground* background,
                                                      gint x, gint y);
+static void greeter_background_set_active_candidate (GreeterBackground* background,
+                                                     const Monitor* candidate);
+static gboolean greeter_background_active_dwell_cb  (GreeterBackground* background);
+static gboolean greeter_background_paint_stats_cb   (GreeterBackground* background);
+static void greeter_background_create_child_window  (GreeterBackground* background);
+static void greeter_background_move_child_window    (GreeterBackground* background,
+                                                     const GdkRectangle* geometry);
+static gboolean greeter_background_child_window_draw_cb(GtkWidget* widget,
+                                                     cairo_t* cr,
+                                                     GreeterBackground* background);
+static void greeter_background_child_window_realize_cb(GtkWidget* widget,
+                                                     GreeterBackground* background);
+static gboolean greeter_background_child_window_enter_notify_cb(GtkWidget* widget,
+                                                     GdkEventCrossing* event,
+                                                     GreeterBackground* background);
 static void greeter_background_try_init_dbus        (GreeterBackground* background);
 static void greeter_background_stop_dbus            (GreeterBackground* background);
+static void greeter_background_dbus_proxy_ready_cb  (GObject* source,
+                                                     GAsyncResult* result,
+                                                     gpointer user_data);
+static void greeter_background_set_lid_state        (GreeterBackground* background,
+                                                     gboolean closed);
 static gboolean greeter_background_monitor_enabled  (GreeterBackground* background,
                                                      const Monitor* monitor);
 static void greeter_background_dbus_changed_cb      (GDBusProxy* proxy,
@@ -235,8 +434,14 @@ static void greeter_background_dbus_changed_cb      (GDBusProxy* proxy,
                                                      GreeterBackground* background);
 static void greeter_background_monitors_changed_cb  (GdkScreen* screen,
                                                      GreeterBackground* background);
+static gboolean greeter_background_monitors_settled_cb(GreeterBackground* background);
+static void greeter_background_keep_active_monitor_visible(GreeterBackground* background);
 static void greeter_background_child_destroyed_cb   (GtkWidget* child,
                                                      GreeterBackground* background);
+static void greeter_background_retire_config        (GreeterBackground* background,
+                                                     MonitorConfig* config);
+static void greeter_background_retire_named_config  (GreeterBackground* background,
+                                                     const gchar* name);
 
 /* struct BackgroundConfig */
 static gboolean background_config_initialize        (BackgroundConfig* config,
@@ -244,25 +449,55 @@ static gboolean background_config_initialize        (BackgroundConfig* config,
 static void background_config_finalize              (BackgroundConfig* config);
 static void background_config_copy                  (const BackgroundConfig* source,
                                                      BackgroundConfig* dest);
+static gboolean background_config_equal             (const BackgroundConfig* a,
+                                                     const BackgroundConfig* b);
+static gboolean gradient_config_parse               (BackgroundConfig* config,
+                                                     const gchar* value);
+static gchar** gradient_split_args                  (const gchar* value);
+static cairo_surface_t* gradient_render             (const BackgroundConfig* config,
+                                                     GdkScreen* screen,
+                                                     gint width, gint height);
+static void gradient_add_noise                      (cairo_surface_t* image);
 
 /* struct MonitorConfig */
 static void monitor_config_free                     (MonitorConfig* config);
 /* Copy source config to dest, return dest. Allocate memory if dest == NULL. */
 static MonitorConfig* monitor_config_copy           (const MonitorConfig* source,
                                                      MonitorConfig* dest);
+static gboolean monitor_config_equal                (const MonitorConfig* a,
+                                                     const MonitorConfig* b);
 
 /* struct Background */
 static Background* background_new                   (const BackgroundConfig* config,
-                                                     const Monitor* monitor,
-                                                     GHashTable* images_cache);
+                                                     cairo_surface_t* image);
 static Background* background_ref                   (Background* bg);
 static void background_unref                        (Background** bg);
 static void background_finalize                     (Background* bg);
+static gboolean background_is_opaque                (const Background* bg,
+                                                     const GdkRectangle* area);
 
 /* struct Monitor */
 static void monitor_finalize                        (Monitor* info);
+static void monitor_free                            (Monitor* monitor);
+static Monitor* monitor_take_matching               (Monitor** monitors,
+                                                     gsize monitors_size,
+                                                     const gchar* name,
+                                                     const GdkRectangle* geometry);
+static void monitor_create_window                   (Monitor* monitor,
+                                                     GdkScreen* screen);
+static void monitor_update_geometry                 (Monitor* monitor,
+                                                     const GdkRectangle* geometry,
+                                                     gint scale);
+static Background* monitor_create_background        (const Monitor* monitor,
+                                                     const BackgroundConfig* config);
 static void monitor_set_background                  (Monitor* monitor,
                                                      Background* background);
+static void monitor_set_custom_background           (Monitor* monitor,
+                                                     const BackgroundConfig* config);
+static void monitor_load_background                 (Monitor* monitor,
+                                                     const BackgroundConfig* config,
+                                                     gboolean custom);
+static void monitor_cancel_loading                  (GCancellable** cancellable);
 static void monitor_start_transition                (Monitor* monitor,
                                                      Background* from,
                                                      Background* to);
@@ -272,23 +507,137 @@ static gboolean monitor_transition_cb               (GtkWidget *widget,
                                                      Monitor* monitor);
 static void monitor_transition_draw_alpha           (const Monitor* monitor,
                                                      cairo_t* cr);
+static gboolean monitor_set_background_source       (const Monitor* monitor,
+                                                     const Background* background,
+                                                     cairo_t* cr);
+static void monitor_set_window_background           (const Monitor* monitor,
+                                                     const Background* background);
+static void monitor_queue_draw                      (const Monitor* monitor);
 static void monitor_draw_background                 (const Monitor* monitor,
                                                      const Background* background,
                                                      cairo_t* cr);
+static void monitor_count_painted                   (Monitor* monitor,
+                                                     cairo_t* cr);
 static gboolean monitor_window_draw_cb              (GtkWidget* widget,
                                                      cairo_t* cr,
-                                                     const Monitor* monitor);
+                                                     Monitor* monitor);
 static gboolean monitor_window_enter_notify_cb      (GtkWidget* widget,
                                                      GdkEventCrossing* event,
                                                      const Monitor* monitor);
-
+static void window_send_take_focus                  (GtkWidget* widget);
+
+/* struct BackgroundLoad */
+static void background_load_free                    (BackgroundLoad* load);
+static void background_load_thread                  (GTask* task,
+                                                     GreeterBackground* background,
+                                                     BackgroundLoad* load,
+                                                     GCancellable* cancellable);
+static void background_load_done_cb                 (GreeterBackground* background,
+                                                     GAsyncResult* result,
+                                                     gpointer user_data);
+static void background_prefetch_done_cb             (GreeterBackground* background,
+                                                     GAsyncResult* result,
+                                                     gpointer user_data);
+static void background_prefetch_thread              (GTask* task,
+                                                     GreeterBackground* background,
+                                                     BackgroundLoad* load,
+                                                     GCancellable* cancellable);
+
+static gchar* disk_cache_get_key                    (const gchar* path,
+                                                     ScalingMode mode,
+                                                     gint width, gint height,
+                                                     BackgroundScaler scaler,
+                                                     gint scale,
+                                                     gint blur, gint dim);
+static cairo_surface_t* disk_cache_load             (const gchar* dir,
+                                                     const gchar* key);
+static void disk_cache_store                        (const gchar* dir,
+                                                     gsize limit,
+                                                     const gchar* key,
+                                                     cairo_surface_t* image);
+static void disk_cache_evict                        (const gchar* dir,
+                                                     gsize limit);
+
+static gchar* images_cache_get_key                  (const gchar* path,
+                                                     ScalingMode mode,
+                                                     gint width, gint height,
+                                                     BackgroundScaler scaler,
+                                                     gint cover_width, gint cover_height,
+                                                     gchar** source_key);
+static GdkPixbuf* images_cache_lookup               (ImagesCache* cache,
+                                                     const gchar* key);
+static void images_cache_insert                     (ImagesCache* cache,
+                                                     const gchar* key,
+                                                     GdkPixbuf* image);
+static void images_cache_evict                      (ImagesCache* cache);
+static GdkPixbuf* images_cache_load_source          (ImagesCache* cache,
+                                                     const gchar* key,
+                                                     const gchar* path,
+                                                     gint cover_width, gint cover_height);
+
+static gchar* resolve_image_variant                 (const gchar* path,
+                                                     gint width, gint height);
+static gchar* get_image_variant                     (GreeterBackgroundPrivate* priv,
+                                                     const gchar* path,
+                                                     gint width, gint height,
+                                                     gboolean resolve);
+static gboolean parse_variant_size                  (const gchar* name,
+                                                     gint* width, gint* height);
+static GdkPixbuf* load_image_file                   (const gchar* path,
+                                                     gint cover_width, gint cover_height);
 static GdkPixbuf* scale_image_file                  (const gchar* path,
                                                      ScalingMode mode,
                                                      gint width, gint height,
-                                                     GHashTable* cache);
+                                                     gint cover_width, gint cover_height,
+                                                     BackgroundScaler scaler,
+                                                     ImagesCache* cache);
+static GdkPixbuf* process_image_file                (const gchar* path,
+                                                     ScalingMode mode,
+                                                     gint width, gint height,
+                                                     gint cover_width, gint cover_height,
+                                                     BackgroundScaler scaler,
+                                                     gint blur, gint dim,
+                                                     ImagesCache* cache);
+static gchar* effects_cache_key                     (const gchar* key,
+                                                     gint blur, gint dim);
+static GdkPixbuf* apply_image_effects               (GdkPixbuf* source,
+                                                     gint blur, gint dim);
+static void box_blur_rows                           (const guchar* src, guchar* dst,
+                                                     gint width, gint height,
+                                                     gint rowstride, gint channels,
+                                                     gint radius);
+static void box_blur_columns                        (const guchar* src, guchar* dst,
+                                                     gint width, gint height,
+                                                     gint rowstride, gint channels,
+                                                     gint radius);
+static GdkPixbuf* load_source_image_file            (const gchar* path,
+                                                     ScalingMode mode,
+                                                     gint cover_width, gint cover_height,
+                                                     ImagesCache* cache,
+                                                     gchar** source_key);
 static GdkPixbuf* scale_image                       (GdkPixbuf* source,
+                                                     ScalingMode mode,
+                                                     gint width, gint height,
+                                                     BackgroundScaler scaler);
+static void scale_pixbuf                            (GdkPixbuf* source,
+                                                     GdkPixbuf* dest,
+                                                     gdouble offset_x, gdouble offset_y,
+                                                     gdouble scale_x, gdouble scale_y,
+                                                     BackgroundScaler scaler);
+static cairo_surface_t* create_server_surface       (GdkScreen* screen,
+                                                     cairo_surface_t* image);
+#ifdef HAVE_XSHM
+static gboolean upload_image_shm                    (GdkScreen* screen,
+                                                     cairo_surface_t* target,
+                                                     cairo_surface_t* image);
+#endif
+static gboolean render_scaling_available            (GdkDisplay* gdk_display);
+static cairo_surface_t* create_scaled_server_surface(GdkScreen* screen,
+                                                     cairo_surface_t* source,
                                                      ScalingMode mode,
                                                      gint width, gint height);
+static gboolean compare_render_scaling              (cairo_surface_t* result,
+                                                     cairo_surface_t* reference);
 static cairo_surface_t* create_root_surface         (GdkScreen* screen);
 static void set_root_pixmap_id                      (GdkScreen* screen,
                                                      Display* display,
@@ -314,6 +663,8 @@ static const MonitorConfig DEFAULT_MONITOR_CONFIG =
     },
     .user_bg = TRUE,
     .laptop = FALSE,
+    .blur = 0,
+    .dim = 0,
     .transition =
     {
         .duration = 500,
@@ -348,21 +699,56 @@ greeter_background_init(GreeterBackground* self)
     priv->screen = NULL;
     priv->screen_monitors_changed_handler_id = 0;
     priv->accel_groups = NULL;
+    priv->child_window = NULL;
+    priv->child_window_enabled = FALSE;
 
     priv->configs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)monitor_config_free);
     priv->default_config = monitor_config_copy(&DEFAULT_MONITOR_CONFIG, NULL);
+    priv->retired_configs = NULL;
 
     priv->monitors = NULL;
     priv->monitors_size = 0;
     priv->monitors_map = NULL;
+    priv->monitors_settle_delay = 0;
+    priv->monitors_settle_id = 0;
+    priv->monitors_changes_pending = 0;
+    priv->monitors_changes_avoided = 0;
+    priv->paint_stats_id = 0;
 
     priv->customized_monitors = NULL;
     priv->customized_background.type = BACKGROUND_TYPE_INVALID;
     priv->active_monitors_config = NULL;
     priv->active_monitor = NULL;
+    priv->active_monitor_candidate = NULL;
+    priv->active_monitor_dwell_id = 0;
+
+    priv->images_cache.table = g_hash_table_new(g_str_hash, g_str_equal);
+    g_queue_init(&priv->images_cache.lru);
+    g_mutex_init(&priv->images_cache.lock);
+    priv->images_cache.loading = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_cond_init(&priv->images_cache.loaded);
+    priv->images_cache.size = 0;
+    priv->images_cache.limit = 0;
+    priv->images_cache.hits = 0;
+    priv->images_cache.misses = 0;
+    priv->images_cache.evictions = 0;
+    priv->images_cover_width = 0;
+    priv->images_cover_height = 0;
+    priv->images_scaler = BACKGROUND_SCALER_BILINEAR;
+    priv->render_sources = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)cairo_surface_destroy);
+    priv->render_jobs = 0;
+    priv->render_checked = FALSE;
+    priv->render_check_running = FALSE;
+    priv->prefetch_jobs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    priv->prefetch_cancellable = g_cancellable_new();
+    priv->image_variants = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    g_mutex_init(&priv->image_variants_lock);
+    priv->disk_cache_dir = NULL;
+    priv->disk_cache_limit = 0;
 
     priv->laptop_monitors = NULL;
     priv->laptop_upower_proxy = NULL;
+    priv->laptop_upower_cancellable = NULL;
     priv->laptop_lid_closed = FALSE;
 }
 
@@ -394,7 +780,7 @@ greeter_background_set_active_monitor_config(GreeterBackground* background,
     g_list_free_full(priv->active_monitors_config, g_free);
     priv->active_monitors_config = NULL;
     priv->active_monitor_change_in_progress = FALSE;
-    priv->active_monitor_change_last_timestamp = 0;
+    greeter_background_set_active_candidate(background, NULL);
 
     priv->follow_cursor = FALSE;
     priv->follow_cursor_to_init = FALSE;
@@ -427,7 +813,9 @@ greeter_background_set_monitor_config(GreeterBackground* background,
                                       gint user_bg,
                                       gint laptop,
                                       gint transition_duration,
-                                      TransitionType transition_type)
+                                      TransitionType transition_type,
+                                      gint blur,
+                                      gint dim)
 {
     GreeterBackgroundPrivate *priv;
     MonitorConfig            *config;
@@ -445,6 +833,8 @@ greeter_background_set_monitor_config(GreeterBackground* background,
         background_config_copy(&FALLBACK->bg, &config->bg);
     config->user_bg = user_bg >= 0 ? user_bg : FALLBACK->user_bg;
     config->laptop = laptop >= 0 ? laptop : FALLBACK->laptop;
+    config->blur = blur >= 0 ? blur : FALLBACK->blur;
+    config->dim = dim >= 0 ? MIN(dim, 100) : FALLBACK->dim;
     config->transition.duration = transition_duration >= 0 ? transition_duration : FALLBACK->transition.duration;
     config->transition.draw = FALLBACK->transition.draw;
 
@@ -462,11 +852,14 @@ greeter_background_set_monitor_config(GreeterBackground* background,
     }
 
     if(FALLBACK == priv->default_config)
+    {
+        greeter_background_retire_named_config(background, name);
         g_hash_table_insert(priv->configs, g_strdup(name), config);
+    }
     else
     {
         if(priv->default_config)
-            monitor_config_free(priv->default_config);
+            greeter_background_retire_config(background, priv->default_config);
         priv->default_config = config;
     }
 }
@@ -476,7 +869,124 @@ greeter_background_remove_monitor_config(GreeterBackground* background,
                                          const gchar* name)
 {
     g_return_if_fail(GREETER_IS_BACKGROUND(background));
-    g_hash_table_remove(background->priv->configs, name);
+    greeter_background_retire_named_config(background, name);
+}
+
+/* Config can be used by existing monitors, it is freed after reconfiguration */
+static void
+greeter_background_retire_config(GreeterBackground* background,
+                                 MonitorConfig* config)
+{
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    if(priv->screen)
+        priv->retired_configs = g_slist_prepend(priv->retired_configs, config);
+    else
+        monitor_config_free(config);
+}
+
+static void
+greeter_background_retire_named_config(GreeterBackground* background,
+                                       const gchar* name)
+{
+    GreeterBackgroundPrivate *priv = background->priv;
+    gpointer                  key;
+    gpointer                  config;
+
+    if(!g_hash_table_lookup_extended(priv->configs, name, &key, &config))
+        return;
+
+    g_hash_table_steal(priv->configs, name);
+    g_free(key);
+    greeter_background_retire_config(background, config);
+}
+
+void
+greeter_background_set_separate_window(GreeterBackground* background,
+                                       gboolean enabled)
+{
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+    g_return_if_fail(background->priv->screen == NULL);
+    background->priv->child_window_enabled = enabled;
+}
+
+void
+greeter_background_set_paint_stats(GreeterBackground* background,
+                                   gboolean enabled)
+{
+    GreeterBackgroundPrivate* priv;
+
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+
+    priv = background->priv;
+
+    if(enabled && !priv->paint_stats_id)
+        priv->paint_stats_id = g_timeout_add_seconds(1, (GSourceFunc)greeter_background_paint_stats_cb, background);
+    else if(!enabled && priv->paint_stats_id)
+    {
+        g_source_remove(priv->paint_stats_id);
+        priv->paint_stats_id = 0;
+    }
+}
+
+void
+greeter_background_set_monitors_settle_delay(GreeterBackground* background,
+                                             gint delay)
+{
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+    background->priv->monitors_settle_delay = MAX(delay, 0);
+}
+
+void
+greeter_background_set_cache_size(GreeterBackground* background,
+                                  gint size_mb)
+{
+    ImagesCache *cache;
+
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+
+    cache = &background->priv->images_cache;
+    g_mutex_lock(&cache->lock);
+    cache->limit = size_mb > 0 ? (gsize)size_mb*1024*1024 : 0;
+    images_cache_evict(cache);
+    g_mutex_unlock(&cache->lock);
+}
+
+void
+greeter_background_set_disk_cache(GreeterBackground* background,
+                                  const gchar* path,
+                                  gint size_mb)
+{
+    GreeterBackgroundPrivate *priv;
+
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+
+    priv = background->priv;
+
+    g_free(priv->disk_cache_dir);
+    priv->disk_cache_dir = NULL;
+    priv->disk_cache_limit = 0;
+
+    if(!path || size_mb <= 0)
+        return;
+
+    priv->disk_cache_dir = g_build_filename(path, "backgrounds", NULL);
+    priv->disk_cache_limit = (gsize)size_mb*1024*1024;
+    if(g_mkdir_with_parents(priv->disk_cache_dir, 0775) != 0)
+    {
+        g_warning("[Background] Failed to create cache directory %s: %s", priv->disk_cache_dir, g_strerror(errno));
+        g_clear_pointer(&priv->disk_cache_dir, g_free);
+    }
+}
+
+void
+greeter_background_set_scaler(GreeterBackground* background,
+                              BackgroundScaler scaler)
+{
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+    if(scaler == BACKGROUND_SCALER_RENDER && !render_scaling_available(gdk_display_get_default()))
+        scaler = BACKGROUND_SCALER_BILINEAR;
+    background->priv->images_scaler = scaler;
 }
 
 gchar**
@@ -508,11 +1018,15 @@ greeter_background_connect(GreeterBackground* background,
                            GdkScreen* screen)
 {
     GreeterBackgroundPrivate *priv;
-    GHashTable               *images_cache;
     Monitor                  *first_not_skipped_monitor = NULL;
+    Monitor                 **old_monitors = NULL;
+    gsize                     old_monitors_size = 0;
     cairo_region_t           *screen_region;
     gpointer                  saved_focus = NULL;
     guint                     i;
+    guint                     kept = 0;
+    guint                     resized = 0;
+    guint                     removed = 0;
 
     g_return_if_fail(GREETER_IS_BACKGROUND(background));
     g_return_if_fail(GDK_IS_SCREEN(screen));
@@ -523,34 +1037,73 @@ greeter_background_connect(GreeterBackground* background,
 
     priv = background->priv;
     saved_focus = NULL;
+
+    /* Variants could be added or removed since last connection */
+    g_mutex_lock(&priv->image_variants_lock);
+    g_hash_table_remove_all(priv->image_variants);
+    g_mutex_unlock(&priv->image_variants_lock);
+
+    if(priv->monitors_settle_id)
+        g_source_remove(priv->monitors_settle_id);
+    priv->monitors_settle_id = 0;
+    priv->monitors_changes_pending = 0;
+
     if(priv->screen)
     {
         if (priv->active_monitor)
             saved_focus = greeter_save_focus(priv->child);
-        greeter_background_disconnect(background);
+
+        if(priv->screen == screen)
+        {
+            /* Reconfiguration: existing monitors are matched with new ones below */
+            g_signal_handler_disconnect(priv->screen, priv->screen_monitors_changed_handler_id);
+            priv->screen_monitors_changed_handler_id = 0;
+            old_monitors = priv->monitors;
+            old_monitors_size = priv->monitors_size;
+            priv->monitors = NULL;
+            priv->monitors_size = 0;
+            g_hash_table_remove_all(priv->monitors_map);
+            g_clear_pointer(&priv->customized_monitors, g_slist_free);
+            g_clear_pointer(&priv->laptop_monitors, g_slist_free);
+        }
+        else
+            greeter_background_disconnect(background);
     }
 
     priv->screen = screen;
     priv->monitors_size = greeter_screen_get_n_monitors(screen);
-    priv->monitors = g_new0(Monitor, priv->monitors_size);
-    priv->monitors_map = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    priv->monitors = g_new0(Monitor*, priv->monitors_size);
+    if(!priv->monitors_map)
+        priv->monitors_map = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     g_debug("[Background] Monitors found: %" G_GSIZE_FORMAT, priv->monitors_size);
 
+    priv->images_cover_width = 0;
+    priv->images_cover_height = 0;
+    for(i = 0; i < priv->monitors_size; ++i)
+    {
+        GdkRectangle geometry;
+        greeter_screen_get_monitor_geometry(screen, i, &geometry);
+        priv->images_cover_width = MAX(priv->images_cover_width, geometry.width);
+        priv->images_cover_height = MAX(priv->images_cover_height, geometry.height);
+    }
+
     /* Used to track situation when all monitors marked as "#skip" */
     first_not_skipped_monitor = NULL;
 
-    images_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
     screen_region = cairo_region_create();
 
     for(i = 0; i < priv->monitors_size; ++i)
     {
         const MonitorConfig* config;
-        Monitor* monitor = &priv->monitors[i];
+        Monitor* monitor;
+        Monitor* old_monitor;
         const gchar* printable_name;
-        gchar* window_name;
-        GSList* item;
-        Background* bg = NULL;
+        GdkRectangle geometry;
+        gint scale;
+
+        monitor = g_new0(Monitor, 1);
+        priv->monitors[i] = monitor;
 
         monitor->object = background;
         monitor->name = g_strdup(greeter_screen_get_monitor_plug_name(screen, i));
@@ -558,7 +1111,10 @@ greeter_background_connect(GreeterBackground* background,
 
         printable_name = monitor->name ? monitor->name : "<unknown>";
 
-        greeter_screen_get_monitor_geometry(screen, i, &monitor->geometry);
+        greeter_screen_get_monitor_geometry(screen, i, &geometry);
+        scale = greeter_screen_get_monitor_scale_factor(screen, i);
+        monitor->geometry = geometry;
+        monitor->scale = scale;
 
         g_debug("[Background] Monitor: %s #%d (%dx%d at %dx%d)%s", printable_name, i,
                 monitor->geometry.width, monitor->geometry.height,
@@ -595,75 +1151,115 @@ greeter_background_connect(GreeterBackground* background,
         }
         cairo_region_union_rectangle(screen_region, &monitor->geometry);
 
-        if(!first_not_skipped_monitor)
-            first_not_skipped_monitor = monitor;
+        /* Same output with the same configuration: keep its window and backgrounds */
+        old_monitor = monitor_take_matching(old_monitors, old_monitors_size, monitor->name, &geometry);
+        if(old_monitor && monitor_config_equal(old_monitor->config, config))
+        {
+            monitor_free(monitor);
+            monitor = old_monitor;
+            priv->monitors[i] = monitor;
+            monitor->number = i;
+            monitor->config = config;
+
+            if(monitor->geometry.width != geometry.width || monitor->geometry.height != geometry.height ||
+               monitor->scale != scale)
+            {
+                g_debug("[Background] Monitor %s #%d is resized, reloading its background", printable_name, i);
+                resized++;
+            }
+            else
+                kept++;
 
-        monitor->window = GTK_WINDOW(gtk_window_new(GTK_WINDOW_TOPLEVEL));
-        gtk_window_set_type_hint(monitor->window, GDK_WINDOW_TYPE_HINT_DESKTOP);
-        gtk_window_set_keep_below(monitor->window, TRUE);
-        gtk_window_set_resizable(monitor->window, FALSE);
-        gtk_widget_set_app_paintable(GTK_WIDGET(monitor->window), TRUE);
-        gtk_window_set_screen(monitor->window, screen);
-        gtk_widget_set_size_request(GTK_WIDGET(monitor->window), monitor->geometry.width, monitor->geometry.height);
-        gtk_window_move(monitor->window, monitor->geometry.x, monitor->geometry.y);
-        gtk_widget_show(GTK_WIDGET(monitor->window));
-        monitor->window_draw_handler_id = g_signal_connect(G_OBJECT(monitor->window), "draw",
-                                                           G_CALLBACK(monitor_window_draw_cb),
-                                                           monitor);
-
-        window_name = monitor->name ? g_strdup_printf("monitor-%s", monitor->name) : g_strdup_printf("monitor-%d", i);
-        gtk_widget_set_name(GTK_WIDGET(monitor->window), window_name);
-        gtk_style_context_add_class(gtk_widget_get_style_context(GTK_WIDGET(monitor->window)), "lightdm-gtk-greeter");
-        g_free(window_name);
+            monitor_update_geometry(monitor, &geometry, scale);
+        }
+        else
+        {
+            if(old_monitor)
+            {
+                if(old_monitor == priv->active_monitor)
+                    priv->active_monitor = NULL;
+                monitor_free(old_monitor);
+                removed++;
+            }
 
-        for(item = priv->accel_groups; item != NULL; item = g_slist_next(item))
-            gtk_window_add_accel_group(monitor->window, item->data);
+            monitor->config = config;
+            monitor_create_window(monitor, screen);
 
-        g_signal_connect(G_OBJECT(monitor->window), "enter-notify-event",
-                         G_CALLBACK(monitor_window_enter_notify_cb), monitor);
+            if(config->transition.duration && config->transition.func)
+                monitor->transition.config = config->transition;
 
-        if(config->user_bg)
-            priv->customized_monitors = g_slist_prepend(priv->customized_monitors, monitor);
+            if(config->bg.type == BACKGROUND_TYPE_IMAGE)
+            {
+                /* Window is shown with placeholder color until wallpaper is ready */
+                monitor->background_configured = background_new(&DEFAULT_MONITOR_CONFIG.bg, NULL);
+                monitor_load_background(monitor, &config->bg, FALSE);
+            }
+            else
+                monitor->background_configured = monitor_create_background(monitor, &config->bg);
 
-        if(config->laptop)
-            priv->laptop_monitors = g_slist_prepend(priv->laptop_monitors, monitor);
+            if(config->user_bg && priv->customized_background.type != BACKGROUND_TYPE_INVALID)
+                monitor_set_custom_background(monitor, &priv->customized_background);
 
-        if(config->transition.duration && config->transition.func)
-            monitor->transition.config = config->transition;
+            if(!monitor->background)
+                monitor_set_background(monitor, monitor->background_configured);
+        }
 
-        monitor->background_configured = background_new(&config->bg, monitor, images_cache);
-        if(!monitor->background_configured)
-            monitor->background_configured = background_new(&DEFAULT_MONITOR_CONFIG.bg, monitor, images_cache);
+        if(!first_not_skipped_monitor)
+            first_not_skipped_monitor = monitor;
 
-        if(config->user_bg && priv->customized_background.type != BACKGROUND_TYPE_INVALID)
-            bg = background_new(&priv->customized_background, monitor, images_cache);
+        if(config->user_bg)
+            priv->customized_monitors = g_slist_prepend(priv->customized_monitors, monitor);
 
-        if(bg)
-        {
-            monitor_set_background(monitor, bg);
-            background_unref(&bg);
-        }
-        else
-            monitor_set_background(monitor, monitor->background_configured);
+        if(config->laptop)
+            priv->laptop_monitors = g_slist_prepend(priv->laptop_monitors, monitor);
 
         if(monitor->name)
             g_hash_table_insert(priv->monitors_map, g_strdup(monitor->name), monitor);
         g_hash_table_insert(priv->monitors_map, g_strdup_printf("%d", i), monitor);
     }
-    g_hash_table_unref(images_cache);
 
-    if(priv->laptop_monitors && !priv->laptop_upower_proxy)
+    cairo_region_destroy(screen_region);
+
+    /* Monitors that are gone or can not be reused */
+    for(i = 0; i < old_monitors_size; ++i)
+    {
+        if(!old_monitors[i])
+            continue;
+        if(old_monitors[i] == priv->active_monitor)
+            priv->active_monitor = NULL;
+        if(old_monitors[i]->window)
+            removed++;
+        monitor_free(old_monitors[i]);
+    }
+    g_free(old_monitors);
+
+    g_slist_free_full(priv->retired_configs, (GDestroyNotify)monitor_config_free);
+    priv->retired_configs = NULL;
+
+    if(old_monitors_size)
+        g_debug("[Background] Monitors reconfigured: %u kept, %u resized, %u removed or recreated",
+                kept, resized, removed);
+
+    if(priv->laptop_monitors && !priv->laptop_upower_proxy && !priv->laptop_upower_cancellable)
         greeter_background_try_init_dbus(background);
     else if(!priv->laptop_monitors)
         greeter_background_stop_dbus(background);
 
-    if(priv->follow_cursor_to_init)
+    if(priv->child_window_enabled)
+    {
+        if(!priv->child_window)
+            greeter_background_create_child_window(background);
+        else if(gtk_window_get_screen(priv->child_window) != screen)
+            gtk_window_set_screen(priv->child_window, screen);
+    }
+
+    if(priv->follow_cursor_to_init && !priv->active_monitor)
     {
         gint x, y;
         greeter_background_get_cursor_position(background, &x, &y);
         for(i = 0; i < priv->monitors_size && !priv->active_monitor; ++i)
         {
-            const Monitor* monitor = &priv->monitors[i];
+            const Monitor* monitor = priv->monitors[i];
             if(greeter_background_monitor_enabled(background, monitor) &&
                x >= monitor->geometry.x && x < monitor->geometry.x + monitor->geometry.width &&
                y >= monitor->geometry.y && y < monitor->geometry.y + monitor->geometry.height)
@@ -705,18 +1301,27 @@ greeter_background_disconnect(GreeterBackground* background)
     priv->screen = NULL;
     priv->active_monitor = NULL;
 
+    if(priv->monitors_settle_id)
+        g_source_remove(priv->monitors_settle_id);
+    priv->monitors_settle_id = 0;
+    priv->monitors_changes_pending = 0;
+
     for(i = 0; i < priv->monitors_size; ++i)
-        monitor_finalize(&priv->monitors[i]);
+        monitor_free(priv->monitors[i]);
     g_free(priv->monitors);
     priv->monitors = NULL;
     priv->monitors_size = 0;
 
     g_hash_table_unref(priv->monitors_map);
+    g_hash_table_remove_all(priv->render_sources);
     priv->monitors_map = NULL;
     g_slist_free(priv->customized_monitors);
     priv->customized_monitors = NULL;
     g_slist_free(priv->laptop_monitors);
     priv->laptop_monitors = NULL;
+
+    g_slist_free_full(priv->retired_configs, (GDestroyNotify)monitor_config_free);
+    priv->retired_configs = NULL;
 }
 
 /* Moved to separate function to simplify needless and unnecessary syntax expansion in future (regex) */
@@ -742,29 +1347,13 @@ greeter_background_set_active_monitor(GreeterBackground* background,
 {
     GreeterBackgroundPrivate* priv = background->priv;
     gint x, y;
-    gint64 timestamp;
 
     if (priv->active_monitor_change_in_progress)
         return;
 
-    /* Prevents infinite signal emission between two monitors (LP: #1410406, #1509780)
-     * There are some rare scenarios when using multiple monitors that cause the greeter
-     * to switch back and forth between the monitors indefinitely. By comparing the
-     * timestamp at this precision (1/10th of a second), this should no longer be
-     * possible.
-     */
-    if (active != NULL)
-    {
-        timestamp = floor(g_get_monotonic_time () * 0.00001);
-        if (timestamp == priv->active_monitor_change_last_timestamp)
-        {
-            g_debug("[Background] Preventing infinite monitor loop");
-            return;
-        }
-    }
-
     priv->active_monitor_change_in_progress = TRUE;
-    priv->active_monitor_change_last_timestamp = floor(g_get_monotonic_time () * 0.00001);
+    /* Explicit change overrides pending cursor one */
+    greeter_background_set_active_candidate(background, NULL);
 
     if(active && !active->background)
     {
@@ -796,7 +1385,7 @@ greeter_background_set_active_monitor(GreeterBackground* background,
             if ((guint)num >= priv->monitors_size)
                 goto active_monitor_change_complete;
 
-            active = &priv->monitors[num];
+            active = priv->monitors[num];
             if(!active->background || !greeter_background_monitor_enabled(background, active))
                 active = NULL;
             if(active)
@@ -810,7 +1399,7 @@ greeter_background_set_active_monitor(GreeterBackground* background,
             const Monitor* first_not_skipped = NULL;
             for(i = 0; i < priv->monitors_size && !active; ++i)
             {
-                const Monitor* monitor = &priv->monitors[i];
+                const Monitor* monitor = priv->monitors[i];
                 if(!monitor->background)
                     continue;
                 if(greeter_background_monitor_enabled(background, monitor))
@@ -849,7 +1438,23 @@ greeter_background_set_active_monitor(GreeterBackground* background,
     if (priv->active_monitor == NULL)
         goto active_monitor_change_complete;
 
-    if(priv->child)
+    if(priv->child && priv->child_window)
+    {
+        /* Child stays realized in the same toplevel, keeping its focus */
+        if(!gtk_widget_get_parent(priv->child))
+            gtk_container_add(GTK_CONTAINER(priv->child_window), priv->child);
+
+        greeter_background_move_child_window(background, &active->geometry);
+        gtk_window_set_transient_for(priv->child_window, active->window);
+        /* Background pattern can be set only to realized window */
+        gtk_widget_realize(GTK_WIDGET(priv->child_window));
+        if(active->background && !active->transition.started)
+            monitor_set_window_background(active, active->background);
+        gtk_widget_queue_draw(GTK_WIDGET(priv->child_window));
+        gtk_widget_show(GTK_WIDGET(priv->child_window));
+        gtk_window_present(priv->child_window);
+    }
+    else if(priv->child)
     {
         GtkWidget* old_parent = gtk_widget_get_parent(priv->child);
         gpointer focus = greeter_save_focus(priv->child);
@@ -909,59 +1514,100 @@ static void
 greeter_background_try_init_dbus(GreeterBackground* background)
 {
     GreeterBackgroundPrivate *priv;
-    GError                   *error = NULL;
-    GVariant                 *variant;
-    gboolean                  lid_present;
 
     g_debug("[Background] Creating DBus proxy");
 
     priv = background->priv;
 
-    if(priv->laptop_upower_proxy)
+    if(priv->laptop_upower_proxy || priv->laptop_upower_cancellable)
         greeter_background_stop_dbus(background);
 
-    priv->laptop_upower_proxy = g_dbus_proxy_new_for_bus_sync(
-                                            G_BUS_TYPE_SYSTEM,
-                                            G_DBUS_PROXY_FLAGS_NONE,
-                                            NULL,   /* interface info */
-                                            DBUS_UPOWER_NAME,
-                                            DBUS_UPOWER_PATH,
-                                            DBUS_UPOWER_INTERFACE,
-                                            NULL,   /* cancellable */
-                                            &error);
-    if(!priv->laptop_upower_proxy)
+    /* UPower can require DBus activation, do not block startup on it */
+    priv->laptop_upower_cancellable = g_cancellable_new();
+    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SYSTEM,
+                             G_DBUS_PROXY_FLAGS_NONE,
+                             NULL,   /* interface info */
+                             DBUS_UPOWER_NAME,
+                             DBUS_UPOWER_PATH,
+                             DBUS_UPOWER_INTERFACE,
+                             priv->laptop_upower_cancellable,
+                             greeter_background_dbus_proxy_ready_cb,
+                             background);
+}
+
+static void
+greeter_background_dbus_proxy_ready_cb(GObject* source,
+                                       GAsyncResult* result,
+                                       gpointer user_data)
+{
+    GreeterBackground        *background = GREETER_BACKGROUND(user_data);
+    GreeterBackgroundPrivate *priv = background->priv;
+    GDBusProxy               *proxy;
+    GError                   *error = NULL;
+    GVariant                 *variant;
+    gboolean                  lid_present = FALSE;
+    gboolean                  lid_closed = FALSE;
+
+    proxy = g_dbus_proxy_new_for_bus_finish(result, &error);
+    if(!proxy)
     {
+        /* Stopped or restarted, priv fields belong to another request now */
+        if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_clear_error(&error);
+            return;
+        }
         if(error)
             g_warning("[Background] Failed to create dbus proxy: %s", error->message);
         g_clear_error(&error);
+        g_clear_object(&priv->laptop_upower_cancellable);
         return;
     }
 
-    variant = g_dbus_proxy_get_cached_property(priv->laptop_upower_proxy, DBUS_UPOWER_PROP_LID_IS_PRESENT);
-    lid_present = g_variant_get_boolean(variant);
-    g_variant_unref(variant);
+    g_clear_object(&priv->laptop_upower_cancellable);
+
+    variant = g_dbus_proxy_get_cached_property(proxy, DBUS_UPOWER_PROP_LID_IS_PRESENT);
+    if(variant)
+    {
+        lid_present = g_variant_get_boolean(variant);
+        g_variant_unref(variant);
+    }
 
     g_debug("[Background] UPower.%s property value: %d", DBUS_UPOWER_PROP_LID_IS_PRESENT, lid_present);
 
     if(!lid_present)
-        greeter_background_stop_dbus(background);
-    else
     {
-        variant = g_dbus_proxy_get_cached_property(priv->laptop_upower_proxy, DBUS_UPOWER_PROP_LID_IS_CLOSED);
-        priv->laptop_lid_closed = g_variant_get_boolean(variant);
-        g_variant_unref(variant);
+        g_object_unref(proxy);
+        return;
+    }
 
-        g_signal_connect(priv->laptop_upower_proxy, "g-properties-changed",
-                         G_CALLBACK(greeter_background_dbus_changed_cb), background);
+    variant = g_dbus_proxy_get_cached_property(proxy, DBUS_UPOWER_PROP_LID_IS_CLOSED);
+    if(variant)
+    {
+        lid_closed = g_variant_get_boolean(variant);
+        g_variant_unref(variant);
     }
+
+    priv->laptop_upower_proxy = proxy;
+    priv->laptop_lid_closed = FALSE;
+    g_signal_connect(priv->laptop_upower_proxy, "g-properties-changed",
+                     G_CALLBACK(greeter_background_dbus_changed_cb), background);
+
+    /* Lid was considered open while waiting for UPower */
+    greeter_background_set_lid_state(background, lid_closed);
 }
 
 static void
 greeter_background_stop_dbus(GreeterBackground* background)
 {
-    if(!background->priv->laptop_upower_proxy)
-        return;
-    g_clear_object(&background->priv->laptop_upower_proxy);
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    if(priv->laptop_upower_cancellable)
+    {
+        g_cancellable_cancel(priv->laptop_upower_cancellable);
+        g_clear_object(&priv->laptop_upower_cancellable);
+    }
+    g_clear_object(&priv->laptop_upower_proxy);
 }
 
 static gboolean
@@ -981,22 +1627,30 @@ greeter_background_dbus_changed_cb(GDBusProxy* proxy,
                                    const gchar* const* invalidated_properties,
                                    GreeterBackground* background)
 {
-    GreeterBackgroundPrivate *priv;
     GVariant                 *variant;
     gboolean                  new_state;
 
     g_return_if_fail(GREETER_IS_BACKGROUND(background));
 
-    priv = background->priv;
-
-    variant = g_dbus_proxy_get_cached_property(priv->laptop_upower_proxy, DBUS_UPOWER_PROP_LID_IS_CLOSED);
+    variant = g_dbus_proxy_get_cached_property(background->priv->laptop_upower_proxy, DBUS_UPOWER_PROP_LID_IS_CLOSED);
+    if(!variant)
+        return;
     new_state = g_variant_get_boolean(variant);
     g_variant_unref(variant);
 
-    if(new_state == priv->laptop_lid_closed)
+    greeter_background_set_lid_state(background, new_state);
+}
+
+static void
+greeter_background_set_lid_state(GreeterBackground* background,
+                                 gboolean closed)
+{
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    if(closed == priv->laptop_lid_closed)
         return;
 
-    priv->laptop_lid_closed = new_state;
+    priv->laptop_lid_closed = closed;
     g_debug("[Background] UPower: lid state changed to '%s'", priv->laptop_lid_closed ? "closed" : "opened");
 
     if(priv->laptop_monitors)
@@ -1018,58 +1672,247 @@ static void
 greeter_background_monitors_changed_cb(GdkScreen* screen,
                                        GreeterBackground* background)
 {
-    g_return_if_fail(GREETER_IS_BACKGROUND(background));
-    greeter_background_connect(background, screen);
-}
-
-static void
-greeter_background_child_destroyed_cb(GtkWidget* child,
-                                      GreeterBackground* background)
-{
-    background->priv->child = NULL;
-}
-
-void
-greeter_background_set_custom_background(GreeterBackground* background,
-                                         const gchar* value)
-{
-    GreeterBackgroundPrivate *priv;
-    GHashTable               *images_cache = NULL;
-    GSList                   *iter;
+    GreeterBackgroundPrivate* priv;
 
     g_return_if_fail(GREETER_IS_BACKGROUND(background));
 
     priv = background->priv;
 
-    if(priv->customized_background.type != BACKGROUND_TYPE_INVALID)
-        background_config_finalize(&priv->customized_background);
-    background_config_initialize(&priv->customized_background, value);
-
-    if(!priv->customized_monitors)
+    if(!priv->monitors_settle_delay)
+    {
+        greeter_background_connect(background, screen);
         return;
+    }
 
-    if(priv->customized_background.type == BACKGROUND_TYPE_IMAGE)
-        images_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
-
-    for(iter = priv->customized_monitors; iter; iter = g_slist_next(iter))
+    /* Wait until layout stays unchanged for monitors_settle_delay */
+    if(priv->monitors_settle_id)
     {
-        Monitor *monitor = iter->data;
+        g_source_remove(priv->monitors_settle_id);
+        priv->monitors_changes_avoided++;
+    }
+    priv->monitors_changes_pending++;
+    priv->monitors_settle_id = g_timeout_add(priv->monitors_settle_delay,
+                                             (GSourceFunc)greeter_background_monitors_settled_cb,
+                                             background);
 
-        /* Old background_custom (if used) will be unrefed in monitor_set_background() */
-        Background* bg = NULL;
-        if(priv->customized_background.type != BACKGROUND_TYPE_INVALID)
-            bg = background_new(&priv->customized_background, monitor, images_cache);
-        if(bg)
-        {
-            monitor_set_background(monitor, bg);
-            background_unref(&bg);
-        }
-        else
-            monitor_set_background(monitor, monitor->background_configured);
+    greeter_background_keep_active_monitor_visible(background);
+}
+
+static gboolean
+greeter_background_monitors_settled_cb(GreeterBackground* background)
+{
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    g_debug("[Background] Monitors layout settled after %u change(s), reconfigurations avoided: %u",
+            priv->monitors_changes_pending, priv->monitors_changes_avoided);
+
+    priv->monitors_settle_id = 0;
+    greeter_background_connect(background, priv->screen);
+    return G_SOURCE_REMOVE;
+}
+
+/* Moves active monitor window to primary monitor if its output is gone, until reconfiguration */
+static void
+greeter_background_keep_active_monitor_visible(GreeterBackground* background)
+{
+    GreeterBackgroundPrivate* priv = background->priv;
+    GdkRectangle              geometry;
+    gint                      i;
+    gint                      n_monitors;
+
+    if(!priv->active_monitor || !priv->active_monitor->window)
+        return;
+
+    n_monitors = greeter_screen_get_n_monitors(priv->screen);
+    for(i = 0; i < n_monitors; ++i)
+    {
+        greeter_screen_get_monitor_geometry(priv->screen, i, &geometry);
+        if(gdk_rectangle_intersect(&priv->active_monitor->geometry, &geometry, NULL))
+            return;
+    }
+
+    i = greeter_screen_get_primary_monitor(priv->screen);
+    if(i < 0 || i >= n_monitors)
+        i = 0;
+    if(i >= n_monitors)
+        return;
+
+    greeter_screen_get_monitor_geometry(priv->screen, i, &geometry);
+    g_debug("[Background] Active monitor %s is gone, moving its window to %dx%d until monitors settle",
+            priv->active_monitor->name, geometry.x, geometry.y);
+    gtk_window_move(priv->active_monitor->window, geometry.x, geometry.y);
+    if(priv->child_window)
+        gtk_window_move(priv->child_window, geometry.x, geometry.y);
+}
+
+/* Cursor entered another monitor: it becomes active only if cursor is still there after dwell time.
+   Crossing events caused by moving windows and warping cursor cannot switch monitors back and forth. */
+static void
+greeter_background_set_active_candidate(GreeterBackground* background,
+                                        const Monitor* candidate)
+{
+    GreeterBackgroundPrivate* priv = background->priv;
+
+    if(priv->active_monitor_dwell_id)
+        g_source_remove(priv->active_monitor_dwell_id);
+    priv->active_monitor_dwell_id = 0;
+    priv->active_monitor_candidate = candidate;
+
+    if(candidate)
+        priv->active_monitor_dwell_id = g_timeout_add(ACTIVE_MONITOR_DWELL_TIME,
+                                                      (GSourceFunc)greeter_background_active_dwell_cb,
+                                                      background);
+}
+
+static gboolean
+greeter_background_active_dwell_cb(GreeterBackground* background)
+{
+    GreeterBackgroundPrivate *priv = background->priv;
+    const Monitor            *candidate = priv->active_monitor_candidate;
+    gint                      x, y;
+
+    priv->active_monitor_dwell_id = 0;
+    priv->active_monitor_candidate = NULL;
+
+    if(!candidate || candidate == priv->active_monitor ||
+       !greeter_background_monitor_enabled(background, candidate))
+        return G_SOURCE_REMOVE;
+
+    greeter_background_get_cursor_position(background, &x, &y);
+    if(x >= candidate->geometry.x && x < candidate->geometry.x + candidate->geometry.width &&
+       y >= candidate->geometry.y && y < candidate->geometry.y + candidate->geometry.height)
+        greeter_background_set_active_monitor(background, candidate);
+    else
+        g_debug("[Background] Cursor left monitor %s #%d before it became active",
+                candidate->name ? candidate->name : "<unknown>", candidate->number);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+greeter_background_paint_stats_cb(GreeterBackground* background)
+{
+    GreeterBackgroundPrivate* priv = background->priv;
+    gsize i;
+
+    for(i = 0; i < priv->monitors_size; ++i)
+    {
+        Monitor* monitor = priv->monitors[i];
+        guint64 area;
+
+        if(!monitor->window || !monitor->painted_frames)
+            continue;
+
+        area = (guint64)monitor->geometry.width*monitor->geometry.height;
+        g_debug("[Background] Monitor %s #%d: %" G_GUINT64_FORMAT " pixels/s painted in %u frames (%.1f screens)",
+                monitor->name ? monitor->name : "<unknown>", monitor->number,
+                monitor->painted_pixels, monitor->painted_frames,
+                area ? (gdouble)monitor->painted_pixels/area : 0.0);
+        monitor->painted_pixels = 0;
+        monitor->painted_frames = 0;
     }
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+greeter_background_create_child_window(GreeterBackground* background)
+{
+    GreeterBackgroundPrivate *priv = background->priv;
+    GSList                   *item;
+
+    priv->child_window = GTK_WINDOW(gtk_window_new(GTK_WINDOW_TOPLEVEL));
+    gtk_window_set_decorated(priv->child_window, FALSE);
+    gtk_window_set_resizable(priv->child_window, FALSE);
+    gtk_window_set_skip_taskbar_hint(priv->child_window, TRUE);
+    gtk_window_set_skip_pager_hint(priv->child_window, TRUE);
+    gtk_widget_set_app_paintable(GTK_WIDGET(priv->child_window), TRUE);
+    gtk_window_set_screen(priv->child_window, priv->screen);
+    gtk_widget_set_name(GTK_WIDGET(priv->child_window), "greeter-window");
+    gtk_style_context_add_class(gtk_widget_get_style_context(GTK_WIDGET(priv->child_window)), "lightdm-gtk-greeter");
+
+    for(item = priv->accel_groups; item != NULL; item = g_slist_next(item))
+        gtk_window_add_accel_group(priv->child_window, item->data);
+
+    g_signal_connect(G_OBJECT(priv->child_window), "realize",
+                     G_CALLBACK(greeter_background_child_window_realize_cb), background);
+    g_signal_connect(G_OBJECT(priv->child_window), "draw",
+                     G_CALLBACK(greeter_background_child_window_draw_cb), background);
+    g_signal_connect(G_OBJECT(priv->child_window), "enter-notify-event",
+                     G_CALLBACK(greeter_background_child_window_enter_notify_cb), background);
+}
+
+static void
+greeter_background_move_child_window(GreeterBackground* background,
+                                     const GdkRectangle* geometry)
+{
+    GtkWindow* window = background->priv->child_window;
+
+    gtk_widget_set_size_request(GTK_WIDGET(window), geometry->width, geometry->height);
+    gtk_window_resize(window, geometry->width, geometry->height);
+    gtk_window_move(window, geometry->x, geometry->y);
+}
+
+/* Child window shows background of active monitor */
+static gboolean
+greeter_background_child_window_draw_cb(GtkWidget* widget,
+                                        cairo_t* cr,
+                                        GreeterBackground* background)
+{
+    Monitor* monitor = (Monitor*)background->priv->active_monitor;
 
-    if(images_cache)
-        g_hash_table_unref(images_cache);
+    if(monitor && background->priv->paint_stats_id)
+        monitor_count_painted(monitor, cr);
+
+    if(monitor && monitor->background && monitor->transition.started)
+        monitor->transition.config.draw(monitor, cr);
+    return FALSE;
+}
+
+/* Window can be realized again (e.g. on screen change), background pattern is lost with old GdkWindow */
+static void
+greeter_background_child_window_realize_cb(GtkWidget* widget,
+                                           GreeterBackground* background)
+{
+    const Monitor* monitor = background->priv->active_monitor;
+
+    if(monitor && monitor->background && !monitor->transition.started)
+        monitor_set_window_background(monitor, monitor->background);
+}
+
+static gboolean
+greeter_background_child_window_enter_notify_cb(GtkWidget* widget,
+                                                GdkEventCrossing* event,
+                                                GreeterBackground* background)
+{
+    greeter_background_set_active_candidate(background, NULL);
+    window_send_take_focus(widget);
+    return FALSE;
+}
+
+static void
+greeter_background_child_destroyed_cb(GtkWidget* child,
+                                      GreeterBackground* background)
+{
+    background->priv->child = NULL;
+}
+
+void
+greeter_background_set_custom_background(GreeterBackground* background,
+                                         const gchar* value)
+{
+    GreeterBackgroundPrivate *priv;
+    GSList                   *iter;
+
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+
+    priv = background->priv;
+
+    if(priv->customized_background.type != BACKGROUND_TYPE_INVALID)
+        background_config_finalize(&priv->customized_background);
+    background_config_initialize(&priv->customized_background, value);
+
+    for(iter = priv->customized_monitors; iter; iter = g_slist_next(iter))
+        monitor_set_custom_background(iter->data, &priv->customized_background);
 }
 
 void
@@ -1077,7 +1920,10 @@ greeter_background_save_xroot(GreeterBackground* background)
 {
     GreeterBackgroundPrivate *priv;
     cairo_surface_t          *surface;
+    cairo_region_t           *uncovered;
     cairo_t                  *cr;
+    cairo_rectangle_int_t     screen_rect = {0, 0, 0, 0};
+    gint64                    started;
     gsize                     i;
 
     const GdkRGBA             ROOT_COLOR = {1.0, 1.0, 1.0, 1.0};
@@ -1085,19 +1931,43 @@ greeter_background_save_xroot(GreeterBackground* background)
     g_return_if_fail(GREETER_IS_BACKGROUND(background));
 
     priv = background->priv;
+    started = g_get_monotonic_time();
     surface = create_root_surface(priv->screen);
+    if(!surface)
+        return;
     cr = cairo_create(surface);
 
-    gdk_cairo_set_source_rgba(cr, &ROOT_COLOR);
-    cairo_paint(cr);
+    screen_rect.width = greeter_screen_get_width(priv->screen);
+    screen_rect.height = greeter_screen_get_height(priv->screen);
+    uncovered = cairo_region_create_rectangle(&screen_rect);
+
+    /* Backgrounds are already on X server: opaque ones are copied as is, without blending */
+    for(i = 0; i < priv->monitors_size; ++i)
+    {
+        const Monitor* monitor = priv->monitors[i];
+        if(!monitor->background)
+            continue;
+        if(background_is_opaque(monitor->background, &monitor->geometry))
+            cairo_region_subtract_rectangle(uncovered, &monitor->geometry);
+    }
+
+    if(!cairo_region_is_empty(uncovered))
+    {
+        gdk_cairo_region(cr, uncovered);
+        gdk_cairo_set_source_rgba(cr, &ROOT_COLOR);
+        cairo_fill(cr);
+    }
+    cairo_region_destroy(uncovered);
 
     for(i = 0; i < priv->monitors_size; ++i)
     {
-        const Monitor* monitor = &priv->monitors[i];
+        const Monitor* monitor = priv->monitors[i];
         if(!monitor->background)
             continue;
         cairo_save(cr);
         cairo_translate(cr, monitor->geometry.x, monitor->geometry.y);
+        if(background_is_opaque(monitor->background, &monitor->geometry))
+            cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
         monitor_draw_background(monitor, monitor->background, cr);
         cairo_restore(cr);
     }
@@ -1105,6 +1975,180 @@ greeter_background_save_xroot(GreeterBackground* background)
 
     cairo_destroy(cr);
     cairo_surface_destroy(surface);
+
+    g_debug("[Background] Root window background saved in %.1f ms", (g_get_monotonic_time() - started)/1000.0);
+}
+
+/* Returns TRUE if custom background can be shown without decoding and scaling */
+gboolean
+greeter_background_is_custom_background_cached(GreeterBackground* background,
+                                               const gchar* value)
+{
+    GreeterBackgroundPrivate *priv;
+    BackgroundConfig          config;
+    GSList                   *iter;
+    GPtrArray                *keys;
+    gboolean                  cached = TRUE;
+    guint                     i;
+
+    g_return_val_if_fail(GREETER_IS_BACKGROUND(background), FALSE);
+
+    priv = background->priv;
+
+    if(!background_config_initialize(&config, value))
+        return TRUE;
+    if(config.type != BACKGROUND_TYPE_IMAGE)
+    {
+        background_config_finalize(&config);
+        return TRUE;
+    }
+
+    keys = g_ptr_array_new_with_free_func(g_free);
+    for(iter = priv->customized_monitors; iter; iter = g_slist_next(iter))
+    {
+        const Monitor* monitor = iter->data;
+        BackgroundScaler scaler;
+        gchar* source_key = NULL;
+        gchar* key;
+        /* Directory is not scanned here, unresolved variant means nothing was loaded yet */
+        gchar* path = get_image_variant(priv, config.options.image.path,
+                                        monitor->geometry.width, monitor->geometry.height, FALSE);
+        if(!path)
+        {
+            cached = FALSE;
+            break;
+        }
+        /* Effects are applied to images scaled by CPU, see greeter_background_prefetch() */
+        scaler = (monitor->config->blur > 0 || monitor->config->dim > 0) &&
+                 priv->images_scaler == BACKGROUND_SCALER_RENDER ?
+                 BACKGROUND_SCALER_BILINEAR : priv->images_scaler;
+        key = images_cache_get_key(path, config.options.image.mode,
+                                   monitor->geometry.width, monitor->geometry.height, scaler,
+                                   priv->images_cover_width, priv->images_cover_height,
+                                   &source_key);
+        g_free(path);
+        /* X server scaling is fast, only source must be ready */
+        if(monitor->config->blur > 0 || monitor->config->dim > 0)
+            g_ptr_array_add(keys, effects_cache_key(key, monitor->config->blur, monitor->config->dim));
+        else if(priv->images_scaler == BACKGROUND_SCALER_RENDER)
+            g_ptr_array_add(keys, g_strdup(source_key));
+        else
+            g_ptr_array_add(keys, g_strdup(key));
+        g_free(source_key);
+        g_free(key);
+    }
+
+    /* Called from UI thread: busy cache is treated as cold instead of waiting for it */
+    if(cached && g_mutex_trylock(&priv->images_cache.lock))
+    {
+        for(i = 0; i < keys->len && cached; ++i)
+            cached = g_hash_table_contains(priv->images_cache.table, keys->pdata[i]);
+        g_mutex_unlock(&priv->images_cache.lock);
+    }
+    else
+        cached = FALSE;
+
+    g_ptr_array_unref(keys);
+    background_config_finalize(&config);
+    return cached;
+}
+
+/* Decodes and scales custom background in background, see greeter_background_is_custom_background_cached() */
+void
+greeter_background_prefetch(GreeterBackground* background,
+                            const gchar* value)
+{
+    GreeterBackgroundPrivate *priv;
+    BackgroundConfig          config;
+    GSList                   *iter;
+    GSList                   *sizes = NULL;
+
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+
+    priv = background->priv;
+
+    /* Result would be thrown away */
+    if(priv->images_cache.limit == 0)
+        return;
+
+    if(greeter_background_is_custom_background_cached(background, value) ||
+       !background_config_initialize(&config, value))
+        return;
+
+    for(iter = priv->customized_monitors; iter; iter = g_slist_next(iter))
+    {
+        const Monitor* monitor = iter->data;
+        BackgroundLoad* load;
+        GTask* task;
+        GSList* size;
+        gchar* key;
+
+        /* One job per distinct monitor size and effects */
+        for(size = sizes; size; size = g_slist_next(size))
+        {
+            const Monitor* other = size->data;
+            if(other->geometry.width == monitor->geometry.width && other->geometry.height == monitor->geometry.height &&
+               other->config->blur == monitor->config->blur && other->config->dim == monitor->config->dim)
+                break;
+        }
+        if(size)
+            continue;
+        sizes = g_slist_prepend(sizes, (gpointer)monitor);
+
+        key = g_strdup_printf("%s\n%dx%d %d %d", value, monitor->geometry.width, monitor->geometry.height,
+                              monitor->config->blur, monitor->config->dim);
+        if(g_hash_table_contains(priv->prefetch_jobs, key))
+        {
+            g_free(key);
+            continue;
+        }
+
+        load = g_new0(BackgroundLoad, 1);
+        load->prefetch_key = key;
+        background_config_copy(&config, &load->config);
+        load->width = monitor->geometry.width;
+        load->height = monitor->geometry.height;
+        load->scale = monitor->scale;
+        load->cover_width = priv->images_cover_width;
+        load->cover_height = priv->images_cover_height;
+        load->scaler = priv->images_scaler;
+        load->custom = TRUE;
+        load->blur = monitor->config->blur;
+        load->dim = monitor->config->dim;
+        if(load->scaler == BACKGROUND_SCALER_RENDER && (load->blur > 0 || load->dim > 0))
+            load->scaler = BACKGROUND_SCALER_BILINEAR;
+
+        g_debug("[Background] Prefetching background %dx%d: %s", load->width, load->height, config.options.image.path);
+
+        task = g_task_new(background, priv->prefetch_cancellable,
+                          (GAsyncReadyCallback)background_prefetch_done_cb, NULL);
+        g_task_set_task_data(task, load, (GDestroyNotify)background_load_free);
+        g_hash_table_insert(priv->prefetch_jobs, g_strdup(key), task);
+        g_task_run_in_thread(task, (GTaskThreadFunc)background_prefetch_thread);
+        g_object_unref(task);
+    }
+
+    g_slist_free(sizes);
+    background_config_finalize(&config);
+}
+
+/* Jobs that are not started yet are dropped, running decodes are finished and cached */
+void
+greeter_background_cancel_prefetch(GreeterBackground* background)
+{
+    GreeterBackgroundPrivate *priv;
+
+    g_return_if_fail(GREETER_IS_BACKGROUND(background));
+
+    priv = background->priv;
+
+    if(g_hash_table_size(priv->prefetch_jobs) == 0)
+        return;
+
+    g_cancellable_cancel(priv->prefetch_cancellable);
+    g_object_unref(priv->prefetch_cancellable);
+    priv->prefetch_cancellable = g_cancellable_new();
+    g_hash_table_remove_all(priv->prefetch_jobs);
 }
 
 const GdkRectangle*
@@ -1134,9 +2178,11 @@ greeter_background_add_accel_group(GreeterBackground* background,
     {
         guint i;
         for(i = 0; i < priv->monitors_size; ++i)
-            if(priv->monitors[i].window)
-                gtk_window_add_accel_group(priv->monitors[i].window, group);
+            if(priv->monitors[i]->window)
+                gtk_window_add_accel_group(priv->monitors[i]->window, group);
     }
+    if(priv->child_window)
+        gtk_window_add_accel_group(priv->child_window, group);
 
     priv->accel_groups = g_slist_append(priv->accel_groups, group);
 }
@@ -1154,6 +2200,17 @@ background_config_initialize(BackgroundConfig* config,
         config->type = BACKGROUND_TYPE_DEFAULT;
     else if(gdk_rgba_parse(&config->options.color, value))
         config->type = BACKGROUND_TYPE_COLOR;
+    else if(g_str_has_prefix(value, GRADIENT_DITHERED_PREFIX) ||
+            g_str_has_prefix(value, GRADIENT_LINEAR_PREFIX) ||
+            g_str_has_prefix(value, GRADIENT_RADIAL_PREFIX))
+    {
+        if(!gradient_config_parse(config, value))
+        {
+            g_warning("[Background] Invalid gradient: %s", value);
+            return FALSE;
+        }
+        config->type = BACKGROUND_TYPE_GRADIENT;
+    }
     else
     {
         const gchar** prefix = SCALING_MODE_PREFIXES;
@@ -1182,6 +2239,9 @@ background_config_finalize(BackgroundConfig* config)
         case BACKGROUND_TYPE_IMAGE:
             g_free(config->options.image.path);
             break;
+        case BACKGROUND_TYPE_GRADIENT:
+            g_free(config->options.gradient.stops);
+            break;
         case BACKGROUND_TYPE_COLOR:
         case BACKGROUND_TYPE_DEFAULT:
         case BACKGROUND_TYPE_SKIP:
@@ -1205,6 +2265,11 @@ background_config_copy(const BackgroundConfig* source,
         case BACKGROUND_TYPE_IMAGE:
             dest->options.image.path = g_strdup(source->options.image.path);
             break;
+        case BACKGROUND_TYPE_GRADIENT:
+            dest->options.gradient.stops = g_new(GradientStop, source->options.gradient.n_stops);
+            memcpy(dest->options.gradient.stops, source->options.gradient.stops,
+                   sizeof(GradientStop)*source->options.gradient.n_stops);
+            break;
         case BACKGROUND_TYPE_COLOR:
         case BACKGROUND_TYPE_DEFAULT:
         case BACKGROUND_TYPE_SKIP:
@@ -1215,92 +2280,396 @@ background_config_copy(const BackgroundConfig* source,
     }
 }
 
-static void
-monitor_config_free(MonitorConfig* config)
-{
-    background_config_finalize(&config->bg);
-    g_free(config);
-}
-
-static MonitorConfig* monitor_config_copy(const MonitorConfig* source,
-                                          MonitorConfig* dest)
+static gboolean
+background_config_equal(const BackgroundConfig* a,
+                        const BackgroundConfig* b)
 {
-    if(!dest)
-        dest = g_new0(MonitorConfig, 1);
-    background_config_copy(&source->bg, &dest->bg);
-    dest->user_bg = source->user_bg;
-    dest->laptop = source->laptop;
-    dest->transition = source->transition;
-    return dest;
-}
+    guint i;
 
-static Background*
-background_new(const BackgroundConfig* config,
-               const Monitor* monitor,
-               GHashTable* images_cache)
-{
-    Background *result;
-    Background  bg = {0};
+    if(a->type != b->type)
+        return FALSE;
 
-    switch(config->type)
+    switch(a->type)
     {
-        case BACKGROUND_TYPE_IMAGE:
-            bg.options.image = scale_image_file(config->options.image.path, config->options.image.mode,
-                                                monitor->geometry.width, monitor->geometry.height,
-                                                images_cache);
-            if(!bg.options.image)
-            {
-                g_warning("[Background] Failed to read wallpaper: %s", config->options.image.path);
-                return NULL;
-            }
-            break;
         case BACKGROUND_TYPE_COLOR:
-            bg.options.color = config->options.color;
-            break;
+            return gdk_rgba_equal(&a->options.color, &b->options.color);
+        case BACKGROUND_TYPE_IMAGE:
+            return a->options.image.mode == b->options.image.mode &&
+                   g_strcmp0(a->options.image.path, b->options.image.path) == 0;
+        case BACKGROUND_TYPE_GRADIENT:
+            if(a->options.gradient.radial != b->options.gradient.radial ||
+               a->options.gradient.angle != b->options.gradient.angle ||
+               a->options.gradient.dithered != b->options.gradient.dithered ||
+               a->options.gradient.n_stops != b->options.gradient.n_stops)
+                return FALSE;
+            for(i = 0; i < a->options.gradient.n_stops; ++i)
+                if(a->options.gradient.stops[i].offset != b->options.gradient.stops[i].offset ||
+                   !gdk_rgba_equal(&a->options.gradient.stops[i].color, &b->options.gradient.stops[i].color))
+                    return FALSE;
+            return TRUE;
         case BACKGROUND_TYPE_DEFAULT:
-            break;
         case BACKGROUND_TYPE_SKIP:
         case BACKGROUND_TYPE_INVALID:
         default:
-            g_return_val_if_reached(NULL);
+            return TRUE;
     }
-
-    bg.type = config->type;
-    bg.ref_count = 1;
-
-    result = g_new(Background, 1);
-    *result = bg;
-    return result;
 }
 
-static Background*
-background_ref(Background* bg)
+/* Splits "a, f(b, c), d)" to {"a", "f(b, c)", "d"}, closing bracket ends the list */
+static gchar**
+gradient_split_args(const gchar* value)
 {
-    bg->ref_count++;
-    return bg;
-}
+    GPtrArray   *args = g_ptr_array_new();
+    const gchar *start = value;
+    const gchar *p;
+    gint         depth = 0;
 
-static void
-background_unref(Background** bg)
-{
-    if(!*bg)
-        return;
-    (*bg)->ref_count--;
-    if((*bg)->ref_count == 0)
+    for(p = value; *p; ++p)
     {
-        background_finalize(*bg);
-        *bg = NULL;
+        if(*p == '(')
+            depth++;
+        else if(*p == ')' && depth > 0)
+            depth--;
+        else if((*p == ',' && depth == 0) || *p == ')')
+        {
+            g_ptr_array_add(args, g_strstrip(g_strndup(start, p - start)));
+            start = p + 1;
+            if(*p == ')')
+                break;
+        }
+    }
+
+    /* No closing bracket */
+    if(!*p)
+    {
+        g_ptr_array_set_free_func(args, g_free);
+        g_ptr_array_free(args, TRUE);
+        return NULL;
     }
+
+    g_ptr_array_add(args, NULL);
+    return (gchar**)g_ptr_array_free(args, FALSE);
 }
 
-static void
-background_finalize(Background* bg)
+/* [#dithered:]linear-gradient([<angle>deg,] <color> [<offset>%], <color> [<offset>%], ...)
+   [#dithered:]radial-gradient(<color> [<offset>%], <color> [<offset>%], ...) */
+static gboolean
+gradient_config_parse(BackgroundConfig* config,
+                      const gchar* value)
 {
-    switch(bg->type)
-    {
-        case BACKGROUND_TYPE_IMAGE:
-            g_clear_object(&bg->options.image);
-            break;
+    gchar  **args;
+    gchar  **arg;
+    GArray  *stops;
+    guint    i;
+
+    config->options.gradient.dithered = g_str_has_prefix(value, GRADIENT_DITHERED_PREFIX);
+    if(config->options.gradient.dithered)
+        value += strlen(GRADIENT_DITHERED_PREFIX);
+
+    if(g_str_has_prefix(value, GRADIENT_LINEAR_PREFIX))
+        config->options.gradient.radial = FALSE;
+    else if(g_str_has_prefix(value, GRADIENT_RADIAL_PREFIX))
+        config->options.gradient.radial = TRUE;
+    else
+        return FALSE;
+
+    args = gradient_split_args(strchr(value, '(') + 1);
+    if(!args)
+        return FALSE;
+
+    arg = args;
+    config->options.gradient.angle = 180.0;
+    if(!config->options.gradient.radial && *arg && g_str_has_suffix(*arg, "deg"))
+        config->options.gradient.angle = g_ascii_strtod(*arg++, NULL);
+
+    stops = g_array_new(FALSE, FALSE, sizeof(GradientStop));
+    for(; *arg; ++arg)
+    {
+        GradientStop stop = {-1.0};
+        gchar* offset = strrchr(*arg, ' ');
+
+        if(offset && g_str_has_suffix(offset, "%") && !strchr(offset, ')'))
+        {
+            *offset++ = '\0';
+            stop.offset = CLAMP(g_ascii_strtod(offset, NULL)/100.0, 0.0, 1.0);
+        }
+        if(!gdk_rgba_parse(&stop.color, g_strstrip(*arg)))
+        {
+            g_array_free(stops, TRUE);
+            g_strfreev(args);
+            return FALSE;
+        }
+        g_array_append_val(stops, stop);
+    }
+    g_strfreev(args);
+
+    if(stops->len < 2)
+    {
+        g_array_free(stops, TRUE);
+        return FALSE;
+    }
+
+    /* Stops without offset are distributed evenly */
+    for(i = 0; i < stops->len; ++i)
+    {
+        GradientStop* stop = &g_array_index(stops, GradientStop, i);
+        if(stop->offset < 0)
+            stop->offset = (gdouble)i/(stops->len - 1);
+    }
+
+    config->options.gradient.n_stops = stops->len;
+    config->options.gradient.stops = (GradientStop*)g_array_free(stops, FALSE);
+    return TRUE;
+}
+
+/* Renders gradient to server-side surface: no image is decoded or kept in client memory */
+static cairo_surface_t*
+gradient_render(const BackgroundConfig* config,
+                GdkScreen* screen,
+                gint width, gint height)
+{
+    cairo_surface_t *surface;
+    cairo_pattern_t *pattern;
+    cairo_t         *cr;
+    cairo_content_t  content = CAIRO_CONTENT_COLOR;
+    guint            i;
+
+    for(i = 0; i < config->options.gradient.n_stops; ++i)
+        if(config->options.gradient.stops[i].color.alpha < 1.0)
+            content = CAIRO_CONTENT_COLOR_ALPHA;
+
+    if(config->options.gradient.radial)
+        pattern = cairo_pattern_create_radial(width/2.0, height/2.0, 0,
+                                              width/2.0, height/2.0, sqrt((gdouble)width*width + (gdouble)height*height)/2);
+    else
+    {
+        /* Gradient line passes through center, its ends touch the farthest corners (as in CSS) */
+        gdouble angle = config->options.gradient.angle*M_PI/180.0;
+        gdouble dx = sin(angle);
+        gdouble dy = -cos(angle);
+        gdouble half = (fabs(width*dx) + fabs(height*dy))/2;
+        pattern = cairo_pattern_create_linear(width/2.0 - dx*half, height/2.0 - dy*half,
+                                              width/2.0 + dx*half, height/2.0 + dy*half);
+    }
+
+    for(i = 0; i < config->options.gradient.n_stops; ++i)
+    {
+        const GradientStop* stop = &config->options.gradient.stops[i];
+        cairo_pattern_add_color_stop_rgba(pattern, stop->offset,
+                                          stop->color.red, stop->color.green, stop->color.blue, stop->color.alpha);
+    }
+
+    surface = gdk_window_create_similar_surface(gdk_screen_get_root_window(screen), content, width, height);
+    cr = cairo_create(surface);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+
+    if(config->options.gradient.dithered)
+    {
+        /* Noise is added to each pixel, so dithered gradient is rendered by CPU and uploaded once */
+        cairo_surface_t *image = cairo_image_surface_create(content == CAIRO_CONTENT_COLOR ?
+                                                            CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32,
+                                                            width, height);
+        cairo_t         *image_cr = cairo_create(image);
+
+        cairo_set_operator(image_cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source(image_cr, pattern);
+        cairo_paint(image_cr);
+        cairo_destroy(image_cr);
+
+        gradient_add_noise(image);
+
+        cairo_set_source_surface(cr, image, 0, 0);
+        cairo_paint(cr);
+        cairo_surface_destroy(image);
+    }
+    else
+    {
+        cairo_set_source(cr, pattern);
+        cairo_paint(cr);
+    }
+    cairo_pattern_destroy(pattern);
+
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+    return surface;
+}
+
+/* Adds -1, 0 or +1 to all color channels of each pixel, tiled pattern breaks visible banding of smooth gradients */
+static void
+gradient_add_noise(cairo_surface_t* image)
+{
+    gint8           *noise = g_new(gint8, GRADIENT_NOISE_SIZE*GRADIENT_NOISE_SIZE);
+    GRand           *rand = g_rand_new_with_seed(GRADIENT_NOISE_SIZE);
+    gboolean         has_alpha = cairo_image_surface_get_format(image) == CAIRO_FORMAT_ARGB32;
+    guchar          *data;
+    gint             stride;
+    gint             width;
+    gint             height;
+    gint             x, y;
+
+    for(x = 0; x < GRADIENT_NOISE_SIZE*GRADIENT_NOISE_SIZE; ++x)
+        noise[x] = g_rand_int_range(rand, -1, 2);
+    g_rand_free(rand);
+
+    cairo_surface_flush(image);
+    data = cairo_image_surface_get_data(image);
+    stride = cairo_image_surface_get_stride(image);
+    width = cairo_image_surface_get_width(image);
+    height = cairo_image_surface_get_height(image);
+
+    for(y = 0; y < height; ++y)
+    {
+        guint32      *row = (guint32*)(data + (gsize)y*stride);
+        const gint8  *noise_row = noise + (y % GRADIENT_NOISE_SIZE)*GRADIENT_NOISE_SIZE;
+
+        for(x = 0; x < width; ++x)
+        {
+            guint32 pixel = row[x];
+            gint    delta = noise_row[x % GRADIENT_NOISE_SIZE];
+            /* Premultiplied color can not exceed alpha */
+            gint    limit = has_alpha ? (gint)(pixel >> 24) : 0xff;
+            gint    r, g, b;
+
+            if(!delta)
+                continue;
+
+            r = CLAMP((gint)((pixel >> 16) & 0xff) + delta, 0, limit);
+            g = CLAMP((gint)((pixel >> 8) & 0xff) + delta, 0, limit);
+            b = CLAMP((gint)(pixel & 0xff) + delta, 0, limit);
+            row[x] = (pixel & 0xff000000) | ((guint32)r << 16) | ((guint32)g << 8) | (guint32)b;
+        }
+    }
+
+    g_free(noise);
+    cairo_surface_mark_dirty(image);
+}
+
+static void
+monitor_config_free(MonitorConfig* config)
+{
+    background_config_finalize(&config->bg);
+    g_free(config);
+}
+
+static MonitorConfig* monitor_config_copy(const MonitorConfig* source,
+                                          MonitorConfig* dest)
+{
+    if(!dest)
+        dest = g_new0(MonitorConfig, 1);
+    background_config_copy(&source->bg, &dest->bg);
+    dest->user_bg = source->user_bg;
+    dest->laptop = source->laptop;
+    dest->blur = source->blur;
+    dest->dim = source->dim;
+    dest->transition = source->transition;
+    return dest;
+}
+
+static gboolean
+monitor_config_equal(const MonitorConfig* a,
+                     const MonitorConfig* b)
+{
+    return a == b ||
+           (background_config_equal(&a->bg, &b->bg) &&
+            a->user_bg == b->user_bg && a->laptop == b->laptop &&
+            a->blur == b->blur && a->dim == b->dim &&
+            a->transition.duration == b->transition.duration &&
+            a->transition.func == b->transition.func &&
+            a->transition.draw == b->transition.draw);
+}
+
+/* Image backgrounds are created from already scaled surface, see monitor_load_background().
+   Gradients are rendered to surface too, see monitor_create_background(). */
+static Background*
+background_new(const BackgroundConfig* config,
+               cairo_surface_t* image)
+{
+    Background *result;
+    Background  bg = {0};
+
+    bg.type = config->type;
+    switch(config->type)
+    {
+        case BACKGROUND_TYPE_IMAGE:
+            g_return_val_if_fail(image != NULL, NULL);
+            bg.options.image = cairo_surface_reference(image);
+            break;
+        case BACKGROUND_TYPE_GRADIENT:
+            g_return_val_if_fail(image != NULL, NULL);
+            /* Drawn the same way as images */
+            bg.type = BACKGROUND_TYPE_IMAGE;
+            bg.options.image = cairo_surface_reference(image);
+            break;
+        case BACKGROUND_TYPE_COLOR:
+            bg.options.color = config->options.color;
+            break;
+        case BACKGROUND_TYPE_DEFAULT:
+            break;
+        case BACKGROUND_TYPE_SKIP:
+        case BACKGROUND_TYPE_INVALID:
+        default:
+            g_return_val_if_reached(NULL);
+    }
+
+    bg.ref_count = 1;
+
+    result = g_new(Background, 1);
+    *result = bg;
+    return result;
+}
+
+static Background*
+background_ref(Background* bg)
+{
+    bg->ref_count++;
+    return bg;
+}
+
+static void
+background_unref(Background** bg)
+{
+    if(!*bg)
+        return;
+    (*bg)->ref_count--;
+    if((*bg)->ref_count == 0)
+    {
+        background_finalize(*bg);
+        *bg = NULL;
+    }
+}
+
+/* Returns TRUE if background fully covers area with opaque pixels */
+static gboolean
+background_is_opaque(const Background* bg,
+                     const GdkRectangle* area)
+{
+    switch(bg->type)
+    {
+        case BACKGROUND_TYPE_IMAGE:
+            if(!bg->options.image || cairo_surface_get_content(bg->options.image) != CAIRO_CONTENT_COLOR)
+                return FALSE;
+            if(cairo_surface_get_type(bg->options.image) == CAIRO_SURFACE_TYPE_XLIB)
+                return cairo_xlib_surface_get_width(bg->options.image) >= area->width &&
+                       cairo_xlib_surface_get_height(bg->options.image) >= area->height;
+            if(cairo_surface_get_type(bg->options.image) == CAIRO_SURFACE_TYPE_IMAGE)
+                return cairo_image_surface_get_width(bg->options.image) >= area->width &&
+                       cairo_image_surface_get_height(bg->options.image) >= area->height;
+            return FALSE;
+        case BACKGROUND_TYPE_COLOR:
+            return bg->options.color.alpha >= 1.0;
+        default:
+            return FALSE;
+    }
+}
+
+static void
+background_finalize(Background* bg)
+{
+    switch(bg->type)
+    {
+        case BACKGROUND_TYPE_IMAGE:
+            g_clear_pointer(&bg->options.image, cairo_surface_destroy);
+            break;
         case BACKGROUND_TYPE_COLOR:
         case BACKGROUND_TYPE_DEFAULT:
             break;
@@ -1341,7 +2710,94 @@ monitor_set_background(Monitor* monitor,
 
     background_unref(&monitor->background);
     monitor->background = background_ref(background);
-    gtk_widget_queue_draw(GTK_WIDGET(monitor->window));
+    if(!monitor->transition.started)
+        monitor_set_window_background(monitor, monitor->background);
+    monitor_queue_draw(monitor);
+}
+
+/* Old custom background (if used) will be unrefed in monitor_set_background() */
+static void
+monitor_set_custom_background(Monitor* monitor,
+                              const BackgroundConfig* config)
+{
+    Background* bg = NULL;
+
+    monitor_cancel_loading(&monitor->loading_custom);
+
+    if(config->type == BACKGROUND_TYPE_IMAGE)
+    {
+        /* Current background stays on screen until new one is loaded */
+        monitor_load_background(monitor, config, TRUE);
+        return;
+    }
+
+    if(config->type != BACKGROUND_TYPE_INVALID)
+        bg = monitor_create_background(monitor, config);
+    if(bg)
+    {
+        monitor_set_background(monitor, bg);
+        background_unref(&bg);
+    }
+    else
+        monitor_set_background(monitor, monitor->background_configured);
+}
+
+static void
+monitor_load_background(Monitor* monitor,
+                        const BackgroundConfig* config,
+                        gboolean custom)
+{
+    GreeterBackgroundPrivate *priv = monitor->object->priv;
+    GCancellable            **cancellable;
+    BackgroundLoad           *load;
+    GTask                    *task;
+
+    cancellable = custom ? &monitor->loading_custom : &monitor->loading_configured;
+    monitor_cancel_loading(cancellable);
+    *cancellable = g_cancellable_new();
+
+    load = g_new0(BackgroundLoad, 1);
+    load->monitor = monitor;
+    background_config_copy(config, &load->config);
+    load->width = monitor->geometry.width;
+    load->height = monitor->geometry.height;
+    load->scale = monitor->scale;
+    load->cover_width = priv->images_cover_width;
+    load->cover_height = priv->images_cover_height;
+    load->scaler = priv->images_scaler;
+    load->custom = custom;
+    load->blur = monitor->config->blur;
+    load->dim = monitor->config->dim;
+
+    /* Effects are applied by CPU to scaled image */
+    if(load->scaler == BACKGROUND_SCALER_RENDER && (load->blur > 0 || load->dim > 0))
+        load->scaler = BACKGROUND_SCALER_BILINEAR;
+
+    if(load->scaler == BACKGROUND_SCALER_RENDER)
+    {
+        priv->render_jobs++;
+        /* Check is retried by next job if this one is cancelled or fails to decode image */
+        load->render_check = !priv->render_checked && !priv->render_check_running;
+        if(load->render_check)
+            priv->render_check_running = TRUE;
+    }
+
+    g_debug("[Background] Loading %s background for monitor %s: %s", custom ? "custom" : "configured",
+            monitor->name, config->options.image.path);
+
+    task = g_task_new(monitor->object, *cancellable, (GAsyncReadyCallback)background_load_done_cb, NULL);
+    g_task_set_task_data(task, load, (GDestroyNotify)background_load_free);
+    g_task_run_in_thread(task, (GTaskThreadFunc)background_load_thread);
+    g_object_unref(task);
+}
+
+static void
+monitor_cancel_loading(GCancellable** cancellable)
+{
+    if(!*cancellable)
+        return;
+    g_cancellable_cancel(*cancellable);
+    g_clear_object(cancellable);
 }
 
 static void
@@ -1355,6 +2811,9 @@ monitor_start_transition(Monitor* monitor,
     monitor->transition.to = background_ref(to);
 
     monitor->transition.started = g_get_monotonic_time();
+    monitor->transition.frames = 0;
+    monitor->transition.last_frame = monitor->transition.started;
+    monitor->transition.max_frame_interval = 0;
     monitor->transition.timer_id = gtk_widget_add_tick_callback(GTK_WIDGET(monitor->window),
                                                                 (GtkTickCallback)monitor_transition_cb,
                                                                 monitor,
@@ -1365,8 +2824,19 @@ monitor_start_transition(Monitor* monitor,
 static void
 monitor_stop_transition(Monitor* monitor)
 {
+    gint64 span;
+
     if(!monitor->transition.timer_id)
         return;
+
+    span = g_get_monotonic_time() - monitor->transition.started;
+    if(monitor->transition.frames > 0 && span > 0)
+        g_debug("[Background] Transition on monitor %s #%d: %u frames in %.0f ms, %.1f fps, longest frame %.1f ms",
+                monitor->name ? monitor->name : "<unknown>", monitor->number,
+                monitor->transition.frames, span/1000.0,
+                monitor->transition.frames*1000000.0/span,
+                monitor->transition.max_frame_interval/1000.0);
+
     gtk_widget_remove_tick_callback(GTK_WIDGET(monitor->window), monitor->transition.timer_id);
     monitor->transition.timer_id = 0;
     monitor->transition.started = 0;
@@ -1380,20 +2850,30 @@ monitor_transition_cb(GtkWidget *widget,
                       GdkFrameClock* frame_clock,
                       Monitor* monitor)
 {
+    gint64  now;
     gint64  span;
     gdouble x;
 
     if(!monitor->transition.timer_id)
         return G_SOURCE_REMOVE;
 
-    span = g_get_monotonic_time() - monitor->transition.started;
+    now = g_get_monotonic_time();
+    monitor->transition.frames++;
+    monitor->transition.max_frame_interval = MAX(monitor->transition.max_frame_interval,
+                                                 now - monitor->transition.last_frame);
+    monitor->transition.last_frame = now;
+
+    span = now - monitor->transition.started;
     x = CLAMP(span/monitor->transition.config.duration/1000.0, 0.0, 1.0);
     monitor->transition.stage = monitor->transition.config.func(x);
 
     if(x >= 1.0)
+    {
         monitor_stop_transition(monitor);
+        monitor_set_window_background(monitor, monitor->background);
+    }
 
-    gtk_widget_queue_draw(GTK_WIDGET(monitor->window));
+    monitor_queue_draw(monitor);
     return x >= 1.0 ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
 }
 
@@ -1401,22 +2881,21 @@ static void
 monitor_transition_draw_alpha(const Monitor* monitor,
                               cairo_t* cr)
 {
-    cairo_pattern_t* alpha_pattern;
-
+    /* Both backgrounds are prepared surfaces (or colors): no intermediate group is required */
     monitor_draw_background(monitor, monitor->transition.from, cr);
-
-    cairo_push_group(cr);
-    monitor_draw_background(monitor, monitor->transition.to, cr);
-    cairo_pop_group_to_source(cr);
-
-    alpha_pattern = cairo_pattern_create_rgba(0.0, 0.0, 0.0, monitor->transition.stage);
-    cairo_mask(cr, alpha_pattern);
-    cairo_pattern_destroy(alpha_pattern);
+    if(monitor_set_background_source(monitor, monitor->transition.to, cr))
+        cairo_paint_with_alpha(cr, monitor->transition.stage);
 }
 
 static void
 monitor_finalize(Monitor* monitor)
 {
+    if(monitor->object && monitor->object->priv->active_monitor_candidate == monitor)
+        greeter_background_set_active_candidate(monitor->object, NULL);
+
+    monitor_cancel_loading(&monitor->loading_configured);
+    monitor_cancel_loading(&monitor->loading_custom);
+
     if(monitor->transition.config.duration)
     {
         monitor_stop_transition(monitor);
@@ -1445,128 +2924,1397 @@ monitor_finalize(Monitor* monitor)
 }
 
 static void
-monitor_draw_background(const Monitor* monitor,
-                        const Background* background,
-                        cairo_t* cr)
+monitor_free(Monitor* monitor)
 {
-    g_return_if_fail(monitor != NULL);
-    g_return_if_fail(background != NULL);
+    monitor_finalize(monitor);
+    g_free(monitor);
+}
 
-    switch(background->type)
+/* Removes from array and returns monitor with the same name (or geometry, if name is unknown) */
+static Monitor*
+monitor_take_matching(Monitor** monitors,
+                      gsize monitors_size,
+                      const gchar* name,
+                      const GdkRectangle* geometry)
+{
+    gsize i;
+
+    for(i = 0; i < monitors_size; ++i)
     {
-        case BACKGROUND_TYPE_IMAGE:
-            if(background->options.image)
-            {
-                gdk_cairo_set_source_pixbuf(cr, background->options.image, 0, 0);
-                cairo_paint(cr);
-            }
-            break;
-        case BACKGROUND_TYPE_COLOR:
-            cairo_rectangle(cr, 0, 0, monitor->geometry.width, monitor->geometry.height);
-            gdk_cairo_set_source_rgba(cr, &background->options.color);
-            cairo_fill(cr);
-            break;
-        case BACKGROUND_TYPE_DEFAULT:
-            break;
-        case BACKGROUND_TYPE_SKIP:
-        case BACKGROUND_TYPE_INVALID:
-        default:
-            g_return_if_reached();
+        Monitor* monitor = monitors[i];
+        if(!monitor || !monitor->window)
+            continue;
+        if(name ? g_strcmp0(monitor->name, name) == 0 :
+                  !monitor->name && gdk_rectangle_equal(&monitor->geometry, geometry))
+        {
+            monitors[i] = NULL;
+            return monitor;
+        }
     }
+    return NULL;
 }
 
-static gboolean
-monitor_window_draw_cb(GtkWidget* widget,
-                       cairo_t* cr,
-                       const Monitor* monitor)
+static void
+monitor_create_window(Monitor* monitor,
+                      GdkScreen* screen)
 {
-    if(!monitor->background)
-        return FALSE;
-
-    if(monitor->transition.started)
-        monitor->transition.config.draw(monitor, cr);
-    else
-        monitor_draw_background(monitor, monitor->background, cr);
-
-    return FALSE;
+    GSList* item;
+    gchar* window_name;
+
+    monitor->window = GTK_WINDOW(gtk_window_new(GTK_WINDOW_TOPLEVEL));
+    gtk_window_set_type_hint(monitor->window, GDK_WINDOW_TYPE_HINT_DESKTOP);
+    gtk_window_set_keep_below(monitor->window, TRUE);
+    gtk_window_set_resizable(monitor->window, FALSE);
+    gtk_widget_set_app_paintable(GTK_WIDGET(monitor->window), TRUE);
+    gtk_window_set_screen(monitor->window, screen);
+    gtk_widget_set_size_request(GTK_WIDGET(monitor->window), monitor->geometry.width, monitor->geometry.height);
+    gtk_window_move(monitor->window, monitor->geometry.x, monitor->geometry.y);
+    gtk_widget_show(GTK_WIDGET(monitor->window));
+    monitor->window_draw_handler_id = g_signal_connect(G_OBJECT(monitor->window), "draw",
+                                                       G_CALLBACK(monitor_window_draw_cb),
+                                                       monitor);
+
+    window_name = monitor->name ? g_strdup_printf("monitor-%s", monitor->name) : g_strdup_printf("monitor-%d", monitor->number);
+    gtk_widget_set_name(GTK_WIDGET(monitor->window), window_name);
+    gtk_style_context_add_class(gtk_widget_get_style_context(GTK_WIDGET(monitor->window)), "lightdm-gtk-greeter");
+    g_free(window_name);
+
+    for(item = monitor->object->priv->accel_groups; item != NULL; item = g_slist_next(item))
+        gtk_window_add_accel_group(monitor->window, item->data);
+
+    g_signal_connect(G_OBJECT(monitor->window), "enter-notify-event",
+                     G_CALLBACK(monitor_window_enter_notify_cb), monitor);
 }
 
-static gboolean
-monitor_window_enter_notify_cb(GtkWidget* widget,
-                               GdkEventCrossing* event,
-                               const Monitor* monitor)
+/* Moves existing monitor window, image backgrounds are reloaded only if monitor size is changed */
+static void
+monitor_update_geometry(Monitor* monitor,
+                        const GdkRectangle* geometry,
+                        gint scale)
 {
-    if(monitor->object->priv->active_monitor == monitor)
+    GreeterBackgroundPrivate* priv = monitor->object->priv;
+    gboolean resized = monitor->geometry.width != geometry->width ||
+                       monitor->geometry.height != geometry->height ||
+                       monitor->scale != scale;
+
+    if(!monitor->name)
     {
-        GdkWindow *gdkwindow = gtk_widget_get_window (widget);
-        Window window = GDK_WINDOW_XID (gdkwindow);
-        Display *display = GDK_WINDOW_XDISPLAY (gdkwindow);
-        XEvent ev = {0};
+        gchar* window_name = g_strdup_printf("monitor-%d", monitor->number);
+        gtk_widget_set_name(GTK_WIDGET(monitor->window), window_name);
+        g_free(window_name);
+    }
 
-        static Atom wm_protocols = None;
-        static Atom wm_take_focus = None;
+    if(monitor->geometry.x != geometry->x || monitor->geometry.y != geometry->y)
+        gtk_window_move(monitor->window, geometry->x, geometry->y);
 
-        if (!wm_protocols)
-            wm_protocols = XInternAtom(display, "WM_PROTOCOLS", False);
-        if (!wm_take_focus)
-            wm_take_focus = XInternAtom(display, "WM_TAKE_FOCUS", False);
+    monitor->geometry = *geometry;
+    monitor->scale = scale;
 
-        ev.xclient.type = ClientMessage;
-        ev.xclient.window = window;
-        ev.xclient.message_type = wm_protocols;
-        ev.xclient.format = 32;
-        ev.xclient.data.l[0] = wm_take_focus;
-        ev.xclient.data.l[1] = CurrentTime;
-        XSendEvent(display, window, False, 0L, &ev);
-    }
-    else if(monitor->object->priv->follow_cursor && greeter_background_monitor_enabled(monitor->object, monitor))
-        greeter_background_set_active_monitor(monitor->object, monitor);
-    return FALSE;
-}
+    if(priv->child_window && priv->active_monitor == monitor)
+        greeter_background_move_child_window(monitor->object, geometry);
 
-static GdkPixbuf*
-scale_image_file(const gchar* path,
-                 ScalingMode mode,
-                 gint width, gint height,
-                 GHashTable* cache)
-{
-    gchar* key = NULL;
-    GdkPixbuf* pixbuf = NULL;
+    if(!resized)
+        return;
 
-    if(cache)
+    gtk_widget_set_size_request(GTK_WIDGET(monitor->window), geometry->width, geometry->height);
+    gtk_window_resize(monitor->window, geometry->width, geometry->height);
+
+    /* Current background is kept on screen until new one is ready */
+    if(monitor->config->bg.type == BACKGROUND_TYPE_IMAGE)
+        monitor_load_background(monitor, &monitor->config->bg, FALSE);
+    else if(monitor->config->bg.type == BACKGROUND_TYPE_GRADIENT)
     {
-        key = g_strdup_printf("%s\n%d %dx%d", path, mode, width, height);
-        if(g_hash_table_lookup_extended(cache, key, NULL, (gpointer*)&pixbuf))
-        {
-            g_free(key);
-            return GDK_PIXBUF(g_object_ref(pixbuf));
-        }
+        Background* old = monitor->background_configured;
+        monitor->background_configured = monitor_create_background(monitor, &monitor->config->bg);
+        if(monitor->background == old)
+            monitor_set_background(monitor, monitor->background_configured);
+        background_unref(&old);
     }
+    if(monitor->config->user_bg &&
+       (priv->customized_background.type == BACKGROUND_TYPE_IMAGE ||
+        priv->customized_background.type == BACKGROUND_TYPE_GRADIENT) &&
+       (monitor->background != monitor->background_configured || monitor->loading_custom))
+        monitor_set_custom_background(monitor, &priv->customized_background);
+    monitor_queue_draw(monitor);
+}
 
-    if(!cache || !g_hash_table_lookup_extended(cache, path, NULL, (gpointer*)&pixbuf))
-    {
-        GError *error = NULL;
-        pixbuf = gdk_pixbuf_new_from_file(path, &error);
-        if(error)
+/* Creates non-image background, gradients are rendered for monitor size */
+static Background*
+monitor_create_background(const Monitor* monitor,
+                          const BackgroundConfig* config)
+{
+    Background      *bg;
+    cairo_surface_t *surface;
+
+    if(config->type != BACKGROUND_TYPE_GRADIENT)
+        return background_new(config, NULL);
+
+    surface = gradient_render(config, monitor->object->priv->screen,
+                              monitor->geometry.width, monitor->geometry.height);
+    bg = background_new(config, surface);
+    cairo_surface_destroy(surface);
+    return bg;
+}
+
+/* Returns FALSE if there is nothing to draw */
+static gboolean
+monitor_set_background_source(const Monitor* monitor,
+                              const Background* background,
+                              cairo_t* cr)
+{
+    g_return_val_if_fail(monitor != NULL, FALSE);
+    g_return_val_if_fail(background != NULL, FALSE);
+
+    switch(background->type)
+    {
+        case BACKGROUND_TYPE_IMAGE:
+            if(!background->options.image)
+                return FALSE;
+            cairo_set_source_surface(cr, background->options.image, 0, 0);
+            return TRUE;
+        case BACKGROUND_TYPE_COLOR:
+            gdk_cairo_set_source_rgba(cr, &background->options.color);
+            return TRUE;
+        case BACKGROUND_TYPE_DEFAULT:
+            return FALSE;
+        case BACKGROUND_TYPE_SKIP:
+        case BACKGROUND_TYPE_INVALID:
+        default:
+            g_return_val_if_reached(FALSE);
+    }
+}
+
+/* Server-side surface (or color) set as X window background: exposed areas are
+   repainted by X server, without sending image from client again */
+static void
+monitor_set_window_background(const Monitor* monitor,
+                              const Background* background)
+{
+    GdkWindow       *window = gtk_widget_get_window(GTK_WIDGET(monitor->window));
+    cairo_pattern_t *pattern = NULL;
+
+    if(!window)
+        return;
+
+    switch(background->type)
+    {
+        case BACKGROUND_TYPE_IMAGE:
+            if(!background->options.image)
+                break;
+            pattern = cairo_pattern_create_for_surface(background->options.image);
+            /* X background pixmap is always tiled */
+            if(cairo_surface_get_type(background->options.image) == CAIRO_SURFACE_TYPE_XLIB &&
+               cairo_xlib_surface_get_width(background->options.image) >= monitor->geometry.width &&
+               cairo_xlib_surface_get_height(background->options.image) >= monitor->geometry.height)
+                cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
+            break;
+        case BACKGROUND_TYPE_COLOR:
+            pattern = cairo_pattern_create_rgba(background->options.color.red, background->options.color.green,
+                                                background->options.color.blue, background->options.color.alpha);
+            break;
+        case BACKGROUND_TYPE_DEFAULT:
+            break;
+        case BACKGROUND_TYPE_SKIP:
+        case BACKGROUND_TYPE_INVALID:
+        default:
+            g_return_if_reached();
+    }
+
+    greeter_window_set_background_pattern(window, pattern);
+
+    /* Child window covers active monitor: it must look like the monitor itself */
+    if(monitor->object->priv->child_window && monitor->object->priv->active_monitor == monitor)
+    {
+        GdkWindow* child_window = gtk_widget_get_window(GTK_WIDGET(monitor->object->priv->child_window));
+        if(child_window)
+            greeter_window_set_background_pattern(child_window, pattern);
+    }
+
+    if(pattern)
+        cairo_pattern_destroy(pattern);
+}
+
+static void
+monitor_queue_draw(const Monitor* monitor)
+{
+    GreeterBackgroundPrivate* priv = monitor->object->priv;
+
+    gtk_widget_queue_draw(GTK_WIDGET(monitor->window));
+    if(priv->child_window && priv->active_monitor == monitor)
+        gtk_widget_queue_draw(GTK_WIDGET(priv->child_window));
+}
+
+/* Fills only damaged part of window: full-screen background is not repainted for small widget updates */
+static void
+monitor_draw_background(const Monitor* monitor,
+                        const Background* background,
+                        cairo_t* cr)
+{
+    cairo_rectangle_list_t* clip;
+
+    if(!monitor_set_background_source(monitor, background, cr))
+        return;
+
+    clip = cairo_copy_clip_rectangle_list(cr);
+    if(clip->status == CAIRO_STATUS_SUCCESS)
+    {
+        gint i;
+        for(i = 0; i < clip->num_rectangles; ++i)
+            cairo_rectangle(cr, clip->rectangles[i].x, clip->rectangles[i].y,
+                            clip->rectangles[i].width, clip->rectangles[i].height);
+    }
+    else
+        cairo_rectangle(cr, 0, 0, monitor->geometry.width, monitor->geometry.height);
+    cairo_rectangle_list_destroy(clip);
+
+    cairo_fill(cr);
+}
+
+static void
+monitor_count_painted(Monitor* monitor,
+                      cairo_t* cr)
+{
+    cairo_rectangle_list_t* clip = cairo_copy_clip_rectangle_list(cr);
+
+    if(clip->status == CAIRO_STATUS_SUCCESS)
+    {
+        gint i;
+        for(i = 0; i < clip->num_rectangles; ++i)
+            monitor->painted_pixels += (guint64)(clip->rectangles[i].width*clip->rectangles[i].height);
+    }
+    else
+        monitor->painted_pixels += (guint64)monitor->geometry.width*monitor->geometry.height;
+    cairo_rectangle_list_destroy(clip);
+
+    monitor->painted_frames++;
+}
+
+static gboolean
+monitor_window_draw_cb(GtkWidget* widget,
+                       cairo_t* cr,
+                       Monitor* monitor)
+{
+    if(monitor->object->priv->paint_stats_id)
+        monitor_count_painted(monitor, cr);
+
+    if(!monitor->background)
+        return FALSE;
+
+    /* Without transition, GDK fills exposed area with window background (see monitor_set_window_background()) */
+    if(monitor->transition.started)
+        monitor->transition.config.draw(monitor, cr);
+
+    return FALSE;
+}
+
+static gboolean
+monitor_window_enter_notify_cb(GtkWidget* widget,
+                               GdkEventCrossing* event,
+                               const Monitor* monitor)
+{
+    if(monitor->object->priv->active_monitor == monitor)
+    {
+        greeter_background_set_active_candidate(monitor->object, NULL);
+        window_send_take_focus(widget);
+    }
+    else if(monitor->object->priv->follow_cursor && greeter_background_monitor_enabled(monitor->object, monitor))
+        greeter_background_set_active_candidate(monitor->object, monitor);
+    return FALSE;
+}
+
+static void
+window_send_take_focus(GtkWidget* widget)
+{
+    GdkWindow *gdkwindow = gtk_widget_get_window (widget);
+    Window window = GDK_WINDOW_XID (gdkwindow);
+    Display *display = GDK_WINDOW_XDISPLAY (gdkwindow);
+    XEvent ev = {0};
+
+    static Atom wm_protocols = None;
+    static Atom wm_take_focus = None;
+
+    if (!wm_protocols)
+        wm_protocols = XInternAtom(display, "WM_PROTOCOLS", False);
+    if (!wm_take_focus)
+        wm_take_focus = XInternAtom(display, "WM_TAKE_FOCUS", False);
+
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = window;
+    ev.xclient.message_type = wm_protocols;
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = wm_take_focus;
+    ev.xclient.data.l[1] = CurrentTime;
+    XSendEvent(display, window, False, 0L, &ev);
+}
+
+static void
+background_load_free(BackgroundLoad* load)
+{
+    background_config_finalize(&load->config);
+    g_free(load->source_key);
+    g_free(load->prefetch_key);
+    if(load->render_reference)
+        cairo_surface_destroy(load->render_reference);
+    g_free(load);
+}
+
+static void
+background_load_thread(GTask* task,
+                       GreeterBackground* background,
+                       BackgroundLoad* load,
+                       GCancellable* cancellable)
+{
+    GreeterBackgroundPrivate *priv = background->priv;
+    cairo_surface_t          *image = NULL;
+    gchar                    *disk_key = NULL;
+    gchar                    *path;
+
+    if(g_task_return_error_if_cancelled(task))
+        return;
+
+    path = get_image_variant(priv, load->config.options.image.path, load->width, load->height, TRUE);
+
+    if(load->scaler == BACKGROUND_SCALER_RENDER)
+    {
+        GdkPixbuf* pixbuf = load_source_image_file(path, load->config.options.image.mode,
+                                                   load->cover_width, load->cover_height,
+                                                   &priv->images_cache, &load->source_key);
+        if(pixbuf && load->render_check)
+        {
+            GdkPixbuf* reference = scale_image(pixbuf, load->config.options.image.mode,
+                                               load->width, load->height, BACKGROUND_SCALER_BILINEAR);
+            load->render_reference = gdk_cairo_surface_create_from_pixbuf(reference, 1, NULL);
+            g_object_unref(reference);
+        }
+        if(pixbuf)
+        {
+            image = gdk_cairo_surface_create_from_pixbuf(pixbuf, 1, NULL);
+            g_object_unref(pixbuf);
+        }
+    }
+    else if(priv->disk_cache_dir)
+    {
+        disk_key = disk_cache_get_key(path, load->config.options.image.mode,
+                                      load->width, load->height, load->scaler, load->scale,
+                                      load->blur, load->dim);
+        if(disk_key)
+            image = disk_cache_load(priv->disk_cache_dir, disk_key);
+    }
+
+    if(!image && load->scaler != BACKGROUND_SCALER_RENDER)
+    {
+        GdkPixbuf* pixbuf = process_image_file(path, load->config.options.image.mode,
+                                               load->width, load->height,
+                                               load->cover_width, load->cover_height,
+                                               load->scaler, load->blur, load->dim,
+                                               &priv->images_cache);
+        if(pixbuf)
+        {
+            /* Premultiplied conversion is done once here: RGB24 for opaque images, ARGB32 otherwise */
+            image = gdk_cairo_surface_create_from_pixbuf(pixbuf, 1, NULL);
+            g_object_unref(pixbuf);
+        }
+        if(image && disk_key && !g_cancellable_is_cancelled(cancellable))
+            disk_cache_store(priv->disk_cache_dir, priv->disk_cache_limit, disk_key, image);
+    }
+    g_free(disk_key);
+
+    if(image)
+        g_task_return_pointer(task, image, (GDestroyNotify)cairo_surface_destroy);
+    else
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                "Failed to read wallpaper: %s", path);
+    g_free(path);
+}
+
+static void
+background_load_done_cb(GreeterBackground* background,
+                        GAsyncResult* result,
+                        gpointer user_data)
+{
+    GreeterBackgroundPrivate *priv = background->priv;
+    BackgroundLoad           *load = g_task_get_task_data(G_TASK(result));
+    Monitor                  *monitor;
+    cairo_surface_t          *image;
+    GError                   *error = NULL;
+
+    if(load->scaler == BACKGROUND_SCALER_RENDER)
+        priv->render_jobs--;
+    if(load->render_check)
+        priv->render_check_running = FALSE;
+
+    image = g_task_propagate_pointer(G_TASK(result), &error);
+    if(!image)
+    {
+        /* Monitor can be already finalized, do not touch it */
+        if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_clear_error(&error);
+            if(priv->render_jobs == 0)
+                g_hash_table_remove_all(priv->render_sources);
+            return;
+        }
+        g_warning("[Background] %s", error->message);
+        g_clear_error(&error);
+    }
+
+    monitor = load->monitor;
+    g_clear_object(load->custom ? &monitor->loading_custom : &monitor->loading_configured);
+
+    if(image && load->scaler == BACKGROUND_SCALER_RENDER)
+    {
+        /* Source is uploaded once, monitors of any size are scaled from it by X server */
+        cairo_surface_t* source = g_hash_table_lookup(priv->render_sources, load->source_key);
+        if(!source)
+        {
+            source = create_server_surface(priv->screen, image);
+            if(priv->render_jobs > 0)
+                g_hash_table_insert(priv->render_sources, g_strdup(load->source_key), cairo_surface_reference(source));
+        }
+        else
+            cairo_surface_reference(source);
+        cairo_surface_destroy(image);
+
+        image = create_scaled_server_surface(priv->screen, source, load->config.options.image.mode,
+                                             load->width, load->height);
+        cairo_surface_destroy(source);
+
+        if(load->render_reference)
+        {
+            priv->render_checked = TRUE;
+            if(!compare_render_scaling(image, load->render_reference))
+            {
+                /* Current image is kept, next ones will be scaled by CPU */
+                g_warning("[Background] Using bilinear scaler instead of X server scaling");
+                priv->images_scaler = BACKGROUND_SCALER_BILINEAR;
+            }
+        }
+    }
+    else if(image)
+    {
+        /* Client-side image is released here, only server copy is kept */
+        cairo_surface_t* server_image = create_server_surface(priv->screen, image);
+        cairo_surface_destroy(image);
+        image = server_image;
+    }
+
+    /* No more jobs can share uploaded sources */
+    if(priv->render_jobs == 0)
+        g_hash_table_remove_all(priv->render_sources);
+
+    if(load->custom)
+    {
+        Background* bg = image ? background_new(&load->config, image) : NULL;
+        if(bg)
+        {
+            monitor_set_background(monitor, bg);
+            background_unref(&bg);
+        }
+        else
+            monitor_set_background(monitor, monitor->background_configured);
+    }
+    else if(image)
+    {
+        /* Replace placeholder, keep custom background if it is shown */
+        Background* placeholder = monitor->background_configured;
+        monitor->background_configured = background_new(&load->config, image);
+        if(monitor->background == placeholder)
+            monitor_set_background(monitor, monitor->background_configured);
+        background_unref(&placeholder);
+    }
+
+    if(image)
+        cairo_surface_destroy(image);
+}
+
+static void
+background_prefetch_done_cb(GreeterBackground* background,
+                            GAsyncResult* result,
+                            gpointer user_data)
+{
+    GreeterBackgroundPrivate *priv = background->priv;
+    BackgroundLoad           *load = g_task_get_task_data(G_TASK(result));
+
+    /* Key can be reused by newer job after cancellation */
+    if(g_hash_table_lookup(priv->prefetch_jobs, load->prefetch_key) == (gpointer)result)
+        g_hash_table_remove(priv->prefetch_jobs, load->prefetch_key);
+}
+
+/* Fills images cache, result is not used */
+static void
+background_prefetch_thread(GTask* task,
+                           GreeterBackground* background,
+                           BackgroundLoad* load,
+                           GCancellable* cancellable)
+{
+    GdkPixbuf* image;
+    gchar* path;
+
+    if(g_task_return_error_if_cancelled(task))
+        return;
+
+    path = get_image_variant(background->priv, load->config.options.image.path, load->width, load->height, TRUE);
+
+    if(load->scaler == BACKGROUND_SCALER_RENDER)
+        image = load_source_image_file(path, load->config.options.image.mode,
+                                       load->cover_width, load->cover_height,
+                                       &background->priv->images_cache, NULL);
+    else
+        image = process_image_file(path, load->config.options.image.mode,
+                                   load->width, load->height,
+                                   load->cover_width, load->cover_height,
+                                   load->scaler, load->blur, load->dim,
+                                   &background->priv->images_cache);
+    g_free(path);
+    if(image)
+        g_object_unref(image);
+    g_task_return_boolean(task, image != NULL);
+}
+
+/* Returns NULL if source file is not accessible */
+static gchar*
+disk_cache_get_key(const gchar* path,
+                   ScalingMode mode,
+                   gint width, gint height,
+                   BackgroundScaler scaler,
+                   gint scale,
+                   gint blur, gint dim)
+{
+    GStatBuf  st;
+    gchar    *key;
+    gchar    *hash;
+
+    if(g_stat(path, &st) != 0)
+        return NULL;
+
+    key = g_strdup_printf("%s\n%" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n%d %dx%d@%d scaler %d\nblur %d dim %d",
+                          path, (gint64)st.st_size, (gint64)st.st_mtime,
+                          mode, width, height, scale, scaler, blur, dim);
+    hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    g_free(key);
+    return hash;
+}
+
+static void
+disk_cache_mapped_file_destroy(gpointer data)
+{
+    g_mapped_file_unref(data);
+}
+
+static cairo_surface_t*
+disk_cache_load(const gchar* dir,
+                const gchar* key)
+{
+    static cairo_user_data_key_t  MAPPED_FILE_KEY;
+
+    GMappedFile                  *mapped;
+    const DiskCacheHeader        *header;
+    const gchar                  *data;
+    cairo_surface_t              *surface;
+    gchar                        *name;
+    gchar                        *path;
+    gsize                         size;
+    gsize                         offset;
+
+    name = g_strconcat(key, DISK_CACHE_SUFFIX, NULL);
+    path = g_build_filename(dir, name, NULL);
+    g_free(name);
+
+    mapped = g_mapped_file_new(path, FALSE, NULL);
+    if(!mapped)
+    {
+        g_free(path);
+        return NULL;
+    }
+
+    data = g_mapped_file_get_contents(mapped);
+    size = g_mapped_file_get_length(mapped);
+    header = (const DiskCacheHeader*)data;
+    offset = (sizeof(DiskCacheHeader) + (size >= sizeof(DiskCacheHeader) ? header->key_length : 0) + 15) & ~(gsize)15;
+
+    if(size < sizeof(DiskCacheHeader) || header->magic != DISK_CACHE_MAGIC ||
+       (header->format != CAIRO_FORMAT_ARGB32 && header->format != CAIRO_FORMAT_RGB24) ||
+       header->width <= 0 || header->height <= 0 ||
+       header->stride != cairo_format_stride_for_width(header->format, header->width) ||
+       size < offset + (gsize)header->stride*header->height ||
+       header->key_length != strlen(key) || memcmp(data + sizeof(DiskCacheHeader), key, header->key_length) != 0)
+    {
+        g_warning("[Background] Invalid cache file, removing it: %s", path);
+        g_mapped_file_unref(mapped);
+        g_unlink(path);
+        g_free(path);
+        return NULL;
+    }
+
+    /* Pixels are used in place, mapped file is released with surface */
+    surface = cairo_image_surface_create_for_data((guchar*)data + offset, header->format,
+                                                  header->width, header->height, header->stride);
+    cairo_surface_set_user_data(surface, &MAPPED_FILE_KEY, mapped, disk_cache_mapped_file_destroy);
+
+    /* Modification time is used to find least recently used files */
+    g_utime(path, NULL);
+    g_debug("[Background] Disk cache hit: %s", path);
+    g_free(path);
+
+    return surface;
+}
+
+static void
+disk_cache_store(const gchar* dir,
+                 gsize limit,
+                 const gchar* key,
+                 cairo_surface_t* image)
+{
+    static const gchar    PADDING[16] = {0};
+
+    DiskCacheHeader        header = {0};
+    const guchar          *pixels;
+    FILE                  *file = NULL;
+    gchar                 *name;
+    gchar                 *path;
+    gchar                 *tmp_path;
+    gsize                  data_size;
+    gint                   fd;
+    gint                   y;
+    gboolean               written;
+
+    cairo_surface_flush(image);
+
+    header.magic = DISK_CACHE_MAGIC;
+    header.key_length = strlen(key);
+    header.format = cairo_image_surface_get_format(image);
+    header.width = cairo_image_surface_get_width(image);
+    header.height = cairo_image_surface_get_height(image);
+    header.stride = cairo_image_surface_get_stride(image);
+    pixels = cairo_image_surface_get_data(image);
+    data_size = (gsize)header.stride*header.height;
+
+    if(data_size > limit)
+        return;
+
+    name = g_strconcat(key, DISK_CACHE_SUFFIX, NULL);
+    path = g_build_filename(dir, name, NULL);
+    tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+    g_free(name);
+
+    fd = g_mkstemp(tmp_path);
+    if(fd >= 0)
+        file = fdopen(fd, "wb");
+
+    written = file &&
+              fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(key, header.key_length, 1, file) == 1 &&
+              fwrite(PADDING, (16 - (sizeof(header) + header.key_length) % 16) % 16, 1, file) <= 1;
+    for(y = 0; written && y < header.height; ++y)
+        written = fwrite(pixels + (gsize)y*header.stride, header.stride, 1, file) == 1;
+
+    if(file)
+        written = (fclose(file) == 0) && written;
+    else if(fd >= 0)
+        g_close(fd, NULL);
+
+    if(written && g_rename(tmp_path, path) == 0)
+        g_debug("[Background] Disk cache stored: %s", path);
+    else
+    {
+        g_warning("[Background] Failed to write cache file %s", path);
+        g_unlink(tmp_path);
+    }
+
+    g_free(tmp_path);
+    g_free(path);
+
+    disk_cache_evict(dir, limit);
+}
+
+typedef struct
+{
+    gchar* path;
+    gint64 mtime;
+    gsize size;
+} DiskCacheFile;
+
+static gint
+disk_cache_file_compare(const DiskCacheFile* a,
+                        const DiskCacheFile* b)
+{
+    return a->mtime < b->mtime ? -1 : a->mtime > b->mtime ? 1 : 0;
+}
+
+/* Remove least recently used files until cache fits its size limit */
+static void
+disk_cache_evict(const gchar* dir,
+                 gsize limit)
+{
+    static GMutex  lock;
+
+    GDir          *gdir;
+    GArray        *files;
+    const gchar   *name;
+    gsize          total = 0;
+    guint          i;
+
+    g_mutex_lock(&lock);
+
+    gdir = g_dir_open(dir, 0, NULL);
+    if(!gdir)
+    {
+        g_mutex_unlock(&lock);
+        return;
+    }
+
+    files = g_array_new(FALSE, FALSE, sizeof(DiskCacheFile));
+    while((name = g_dir_read_name(gdir)))
+    {
+        DiskCacheFile file;
+        GStatBuf st;
+
+        if(!g_str_has_suffix(name, DISK_CACHE_SUFFIX))
+            continue;
+        file.path = g_build_filename(dir, name, NULL);
+        if(g_stat(file.path, &st) != 0)
+        {
+            g_free(file.path);
+            continue;
+        }
+        file.mtime = st.st_mtime;
+        file.size = st.st_size;
+        total += file.size;
+        g_array_append_val(files, file);
+    }
+    g_dir_close(gdir);
+
+    g_array_sort(files, (GCompareFunc)disk_cache_file_compare);
+    for(i = 0; i < files->len; ++i)
+    {
+        DiskCacheFile* file = &g_array_index(files, DiskCacheFile, i);
+        if(total > limit && g_unlink(file->path) == 0)
+        {
+            g_debug("[Background] Disk cache evicted: %s", file->path);
+            total -= file->size;
+        }
+        g_free(file->path);
+    }
+    g_array_free(files, TRUE);
+
+    g_mutex_unlock(&lock);
+}
+
+static void
+images_cache_log(const ImagesCache* cache,
+                 const gchar* event)
+{
+    g_debug("[Background] Images cache %s: %u hits, %u misses, %u evictions, %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " KiB used",
+            event, cache->hits, cache->misses, cache->evictions, cache->size/1024, cache->limit/1024);
+}
+
+static void
+images_cache_entry_free(ImagesCacheEntry* entry)
+{
+    g_free(entry->key);
+    g_object_unref(entry->image);
+    g_free(entry);
+}
+
+/* Returns key of scaled image and (optionally) key of its source */
+static gchar*
+images_cache_get_key(const gchar* path,
+                     ScalingMode mode,
+                     gint width, gint height,
+                     BackgroundScaler scaler,
+                     gint cover_width, gint cover_height,
+                     gchar** source_key)
+{
+    GStatBuf st;
+    gchar* file_id;
+    gchar* key;
+
+    if(mode == SCALING_MODE_SOURCE)
+        cover_width = cover_height = 0;
+
+    /* Cache is long-lived: file can be changed since it was cached */
+    if(g_stat(path, &st) == 0)
+        file_id = g_strdup_printf("%s\n%" G_GINT64_FORMAT " %" G_GINT64_FORMAT,
+                                  path, (gint64)st.st_size, (gint64)st.st_mtime);
+    else
+        file_id = g_strdup(path);
+
+    key = g_strdup_printf("%s\n%d %dx%d scaler %d", file_id, mode, width, height, scaler);
+    if(source_key)
+        *source_key = g_strdup_printf("%s\n@%dx%d", file_id, cover_width, cover_height);
+    g_free(file_id);
+    return key;
+}
+
+/* Must be called with cache->lock held, returns new reference */
+static GdkPixbuf*
+images_cache_lookup(ImagesCache* cache,
+                    const gchar* key)
+{
+    ImagesCacheEntry* entry = g_hash_table_lookup(cache->table, key);
+
+    if(!entry)
+    {
+        cache->misses++;
+        images_cache_log(cache, "miss");
+        return NULL;
+    }
+
+    cache->hits++;
+    g_queue_remove(&cache->lru, entry);
+    g_queue_push_head(&cache->lru, entry);
+    images_cache_log(cache, "hit");
+    return g_object_ref(entry->image);
+}
+
+/* Must be called with cache->lock held */
+static void
+images_cache_insert(ImagesCache* cache,
+                    const gchar* key,
+                    GdkPixbuf* image)
+{
+    ImagesCacheEntry* entry;
+    gsize size = gdk_pixbuf_get_byte_length(image);
+
+    if(size > cache->limit)
+        return;
+
+    entry = g_hash_table_lookup(cache->table, key);
+    if(entry)
+    {
+        g_hash_table_remove(cache->table, entry->key);
+        g_queue_remove(&cache->lru, entry);
+        cache->size -= entry->size;
+        images_cache_entry_free(entry);
+    }
+
+    entry = g_new(ImagesCacheEntry, 1);
+    entry->key = g_strdup(key);
+    entry->image = g_object_ref(image);
+    entry->size = size;
+    g_hash_table_insert(cache->table, entry->key, entry);
+    g_queue_push_head(&cache->lru, entry);
+    cache->size += size;
+
+    images_cache_evict(cache);
+}
+
+/* Must be called with cache->lock held */
+static void
+images_cache_evict(ImagesCache* cache)
+{
+    gboolean evicted = FALSE;
+
+    while(cache->size > cache->limit && !g_queue_is_empty(&cache->lru))
+    {
+        ImagesCacheEntry* entry = g_queue_pop_tail(&cache->lru);
+        g_hash_table_remove(cache->table, entry->key);
+        cache->size -= entry->size;
+        cache->evictions++;
+        images_cache_entry_free(entry);
+        evicted = TRUE;
+    }
+
+    if(evicted)
+        images_cache_log(cache, "eviction");
+}
+
+/* Returns cached source or decodes it, the same source is decoded by one job at a time */
+static GdkPixbuf*
+images_cache_load_source(ImagesCache* cache,
+                         const gchar* key,
+                         const gchar* path,
+                         gint cover_width, gint cover_height)
+{
+    GdkPixbuf* pixbuf;
+
+    g_mutex_lock(&cache->lock);
+    while(g_hash_table_contains(cache->loading, key))
+        g_cond_wait(&cache->loaded, &cache->lock);
+    pixbuf = images_cache_lookup(cache, key);
+    if(!pixbuf)
+        g_hash_table_add(cache->loading, g_strdup(key));
+    g_mutex_unlock(&cache->lock);
+
+    if(pixbuf)
+        return pixbuf;
+
+    pixbuf = load_image_file(path, cover_width, cover_height);
+
+    g_mutex_lock(&cache->lock);
+    if(pixbuf)
+        images_cache_insert(cache, key, pixbuf);
+    g_hash_table_remove(cache->loading, key);
+    g_cond_broadcast(&cache->loaded);
+    g_mutex_unlock(&cache->lock);
+
+    return pixbuf;
+}
+
+typedef struct
+{
+    gint cover_width;
+    gint cover_height;
+    gint source_width;
+    gint source_height;
+} ImageDecodeSize;
+
+static void
+image_loader_size_prepared_cb(GdkPixbufLoader* loader,
+                              gint width,
+                              gint height,
+                              ImageDecodeSize* size)
+{
+    GdkPixbufFormat *format;
+    gchar           *format_name;
+    gint             denom;
+
+    size->source_width = width;
+    size->source_height = height;
+
+    if(size->cover_width <= 0 || size->cover_height <= 0 || width <= 0 || height <= 0)
+        return;
+
+    /* Any other size is resampled by loader and then again by scale_image(), only JPEG
+       can be reduced for free while decoding (DCT scaling by 1/2, 1/4 or 1/8) */
+    format = gdk_pixbuf_loader_get_format(loader);
+    format_name = format ? gdk_pixbuf_format_get_name(format) : NULL;
+    if(g_strcmp0(format_name, "jpeg") == 0)
+    {
+        /* Largest reduction that still covers target in both zoomed and stretched modes */
+        for(denom = 8; denom > 1; denom /= 2)
+            if((width + denom - 1)/denom >= size->cover_width && (height + denom - 1)/denom >= size->cover_height)
+            {
+                gdk_pixbuf_loader_set_size(loader, (width + denom - 1)/denom, (height + denom - 1)/denom);
+                break;
+            }
+    }
+    g_free(format_name);
+}
+
+/* Finds "WIDTHxHEIGHT" in file name, e.g. "wallpaper-1920x1080.png" */
+static gboolean
+parse_variant_size(const gchar* name,
+                   gint* width, gint* height)
+{
+    const gchar* p;
+
+    for(p = name; *p; ++p)
+    {
+        gint w, h;
+        if(!g_ascii_isdigit(*p) || (p > name && g_ascii_isdigit(p[-1])))
+            continue;
+        if(sscanf(p, "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+        {
+            *width = w;
+            *height = h;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Path can be a directory with pre-rendered variants of the same image, sizes are taken from file names.
+   Returns exact or smallest variant covering width x height (largest one if nothing covers it).
+   Returns copy of path if it is not a directory. */
+static gchar*
+resolve_image_variant(const gchar* path,
+                      gint width, gint height)
+{
+    GDir        *dir;
+    const gchar *name;
+    gchar       *best = NULL;
+    gchar       *variant;
+    gint         best_width = 0;
+    gint         best_height = 0;
+    gboolean     best_covers = FALSE;
+
+    if(!g_file_test(path, G_FILE_TEST_IS_DIR))
+        return g_strdup(path);
+
+    dir = g_dir_open(path, 0, NULL);
+    if(!dir)
+        return g_strdup(path);
+
+    while((name = g_dir_read_name(dir)) != NULL)
+    {
+        gint w, h;
+        gboolean covers;
+
+        if(!parse_variant_size(name, &w, &h))
+            continue;
+
+        covers = w >= width && h >= height;
+        if(best && (best_covers ? !covers || (gint64)w*h >= (gint64)best_width*best_height
+                                : !covers && (gint64)w*h <= (gint64)best_width*best_height))
+            continue;
+
+        g_free(best);
+        best = g_strdup(name);
+        best_width = w;
+        best_height = h;
+        best_covers = covers;
+    }
+    g_dir_close(dir);
+
+    if(!best)
+    {
+        g_warning("[Background] No image variants found in directory: %s", path);
+        return g_strdup(path);
+    }
+
+    g_debug("[Background] Using %s variant %dx%d for %dx%d: %s",
+            best_width == width && best_height == height ? "exact" : best_covers ? "larger" : "smaller",
+            best_width, best_height, width, height, best);
+
+    variant = g_build_filename(path, best, NULL);
+    g_free(best);
+    return variant;
+}
+
+/* Returns resolve_image_variant() result, memoized for all threads.
+   Returns NULL if variant is not known yet and resolve is FALSE. */
+static gchar*
+get_image_variant(GreeterBackgroundPrivate* priv,
+                  const gchar* path,
+                  gint width, gint height,
+                  gboolean resolve)
+{
+    gchar* key = g_strdup_printf("%s\n%dx%d", path, width, height);
+    gchar* variant;
+
+    g_mutex_lock(&priv->image_variants_lock);
+    variant = g_strdup(g_hash_table_lookup(priv->image_variants, key));
+    g_mutex_unlock(&priv->image_variants_lock);
+
+    if(variant || !resolve)
+    {
+        g_free(key);
+        return variant;
+    }
+
+    /* Directory is scanned without lock, concurrent jobs may resolve the same variant twice */
+    variant = resolve_image_variant(path, width, height);
+
+    g_mutex_lock(&priv->image_variants_lock);
+    g_hash_table_replace(priv->image_variants, key, g_strdup(variant));
+    g_mutex_unlock(&priv->image_variants_lock);
+    return variant;
+}
+
+/* Decodes image at smallest size covering cover_width x cover_height (full size if cover is 0x0).
+   Loaders with native downscaling (e.g. JPEG) never allocate full size image. */
+static GdkPixbuf*
+load_image_file(const gchar* path,
+                gint cover_width, gint cover_height)
+{
+    ImageDecodeSize  size = {cover_width, cover_height, 0, 0};
+    GdkPixbufLoader *loader;
+    GdkPixbuf       *pixbuf = NULL;
+    GError          *error = NULL;
+    FILE            *file;
+    guchar           buffer[65536];
+    gsize            length;
+
+    file = g_fopen(path, "rb");
+    if(!file)
+    {
+        g_warning("[Background] Failed to load background: %s: %s", path, g_strerror(errno));
+        return NULL;
+    }
+
+    loader = gdk_pixbuf_loader_new();
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(image_loader_size_prepared_cb), &size);
+
+    while(!error && (length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        gdk_pixbuf_loader_write(loader, buffer, length, &error);
+    fclose(file);
+
+    if(!error)
+        gdk_pixbuf_loader_close(loader, &error);
+    else
+        gdk_pixbuf_loader_close(loader, NULL);
+
+    if(!error)
+        pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+
+    if(pixbuf)
+    {
+        gint width = gdk_pixbuf_get_width(pixbuf);
+        gint height = gdk_pixbuf_get_height(pixbuf);
+
+        g_object_ref(pixbuf);
+        if(width != size.source_width || height != size.source_height)
         {
-            g_warning("[Background] Failed to load background: %s", error->message);
-            g_clear_error(&error);
+            gsize bpp = gdk_pixbuf_get_n_channels(pixbuf);
+            gsize full_size = (gsize)size.source_width*size.source_height*bpp;
+            gsize decoded_size = gdk_pixbuf_get_byte_length(pixbuf);
+
+            g_debug("[Background] Image %s decoded at %dx%d instead of %dx%d, %" G_GSIZE_FORMAT " KiB of peak memory saved",
+                    path, width, height, size.source_width, size.source_height,
+                    full_size > decoded_size ? (full_size - decoded_size)/1024 : 0);
         }
-        else if(cache)
-            g_hash_table_insert(cache, g_strdup(path), g_object_ref(pixbuf));
     }
     else
-        pixbuf = g_object_ref(pixbuf);
+    {
+        g_warning("[Background] Failed to load background: %s", error ? error->message : path);
+        g_clear_error(&error);
+    }
 
-    if(pixbuf)
+    g_object_unref(loader);
+    return pixbuf;
+}
+
+/* Scaled image with blur/dim applied, both scaled and final images are cached */
+static GdkPixbuf*
+process_image_file(const gchar* path,
+                   ScalingMode mode,
+                   gint width, gint height,
+                   gint cover_width, gint cover_height,
+                   BackgroundScaler scaler,
+                   gint blur, gint dim,
+                   ImagesCache* cache)
+{
+    GdkPixbuf *scaled;
+    GdkPixbuf *pixbuf = NULL;
+    gchar     *key = NULL;
+
+    if(blur <= 0 && dim <= 0)
+        return scale_image_file(path, mode, width, height, cover_width, cover_height, scaler, cache);
+
+    if(cache)
+    {
+        gchar* scaled_key = images_cache_get_key(path, mode, width, height, scaler, cover_width, cover_height, NULL);
+        key = effects_cache_key(scaled_key, blur, dim);
+        g_free(scaled_key);
+
+        g_mutex_lock(&cache->lock);
+        pixbuf = images_cache_lookup(cache, key);
+        g_mutex_unlock(&cache->lock);
+        if(pixbuf)
+        {
+            g_free(key);
+            return pixbuf;
+        }
+    }
+
+    scaled = scale_image_file(path, mode, width, height, cover_width, cover_height, scaler, cache);
+    if(scaled)
     {
-        GdkPixbuf* scaled = scale_image(pixbuf, mode, width, height);
+        gint64 started = g_get_monotonic_time();
+        pixbuf = apply_image_effects(scaled, blur, dim);
+        g_object_unref(scaled);
+        g_debug("[Background] Effects (blur %d, dim %d%%) applied to %dx%d image in %.1f ms",
+                blur, dim, width, height, (g_get_monotonic_time() - started)/1000.0);
+
         if(cache)
-            g_hash_table_insert(cache, g_strdup(key), g_object_ref(scaled));
+        {
+            g_mutex_lock(&cache->lock);
+            images_cache_insert(cache, key, pixbuf);
+            g_mutex_unlock(&cache->lock);
+        }
+    }
+
+    g_free(key);
+    return pixbuf;
+}
+
+static gchar*
+effects_cache_key(const gchar* key,
+                  gint blur, gint dim)
+{
+    return g_strdup_printf("%s\nblur %d dim %d", key, blur, dim);
+}
+
+/* Three box blur passes approximate gaussian blur with sigma = blur, dimming is applied to the last pass */
+static GdkPixbuf*
+apply_image_effects(GdkPixbuf* source,
+                    gint blur, gint dim)
+{
+    GdkPixbuf *result = gdk_pixbuf_copy(source);
+    guchar    *pixels = gdk_pixbuf_get_pixels(result);
+    gint       width = gdk_pixbuf_get_width(result);
+    gint       height = gdk_pixbuf_get_height(result);
+    gint       rowstride = gdk_pixbuf_get_rowstride(result);
+    gint       channels = gdk_pixbuf_get_n_channels(result);
+
+    if(blur > 0)
+    {
+        /* Variance of box with width w is (w*w - 1)/12 */
+        gint    radius = MAX(1, (gint)((sqrt(4.0*blur*blur + 1) - 1)/2 + 0.5));
+        guchar *temp = g_malloc((gsize)rowstride*height);
+        gint    pass;
+
+        for(pass = 0; pass < 3; ++pass)
+        {
+            box_blur_rows(pixels, temp, width, height, rowstride, channels, radius);
+            box_blur_columns(temp, pixels, width, height, rowstride, channels, radius);
+        }
+        g_free(temp);
+    }
+
+    if(dim > 0)
+    {
+        /* Fixed point factor, alpha is not changed */
+        guint factor = (100 - dim)*256/100;
+        gint  color_channels = MIN(channels, 3);
+        gint  x, y, c;
+
+        for(y = 0; y < height; ++y)
+        {
+            guchar* row = pixels + (gsize)y*rowstride;
+            for(x = 0; x < width; ++x)
+                for(c = 0; c < color_channels; ++c)
+                    row[x*channels + c] = (row[x*channels + c]*factor) >> 8;
+        }
+    }
+
+    return result;
+}
+
+/* Sliding window along each row, edge pixels are repeated */
+static void
+box_blur_rows(const guchar* src, guchar* dst,
+              gint width, gint height,
+              gint rowstride, gint channels,
+              gint radius)
+{
+    /* (sum + half)*scale >> 32 is exactly rounded sum/(2*radius + 1), truncated 16 bit reciprocal darkened the image */
+    guint32 half = radius;
+    guint64 scale = (G_GUINT64_CONSTANT(1) << 32)/(2*radius + 1) + 1;
+    gint    x, y, c;
+
+    for(y = 0; y < height; ++y)
+    {
+        const guchar* in = src + (gsize)y*rowstride;
+        guchar*       out = dst + (gsize)y*rowstride;
+
+        for(c = 0; c < channels; ++c)
+        {
+            guint32 sum = 0;
+            gint    i;
+
+            for(i = -radius; i <= radius; ++i)
+                sum += in[CLAMP(i, 0, width - 1)*channels + c];
+
+            for(x = 0; x < width; ++x)
+            {
+                out[x*channels + c] = ((sum + half)*scale) >> 32;
+                sum += in[MIN(x + radius + 1, width - 1)*channels + c];
+                sum -= in[MAX(x - radius, 0)*channels + c];
+            }
+        }
+    }
+}
+
+/* Sliding window along columns: whole rows are added and subtracted, it is cache friendly and vectorizable */
+static void
+box_blur_columns(const guchar* src, guchar* dst,
+                 gint width, gint height,
+                 gint rowstride, gint channels,
+                 gint radius)
+{
+    guint32  half = radius;
+    guint64  scale = (G_GUINT64_CONSTANT(1) << 32)/(2*radius + 1) + 1;
+    gint     n = width*channels;
+    guint32 *sums = g_new0(guint32, n);
+    gint     i, x, y;
+
+    for(i = -radius; i <= radius; ++i)
+    {
+        const guchar* in = src + (gsize)CLAMP(i, 0, height - 1)*rowstride;
+        for(x = 0; x < n; ++x)
+            sums[x] += in[x];
+    }
+
+    for(y = 0; y < height; ++y)
+    {
+        const guchar* add = src + (gsize)MIN(y + radius + 1, height - 1)*rowstride;
+        const guchar* sub = src + (gsize)MAX(y - radius, 0)*rowstride;
+        guchar*       out = dst + (gsize)y*rowstride;
+
+        for(x = 0; x < n; ++x)
+        {
+            out[x] = ((sums[x] + half)*scale) >> 32;
+            sums[x] += add[x] - sub[x];
+        }
+    }
+
+    g_free(sums);
+}
+
+/* Returns decoded (not scaled) image, shared through cache */
+static GdkPixbuf*
+load_source_image_file(const gchar* path,
+                       ScalingMode mode,
+                       gint cover_width, gint cover_height,
+                       ImagesCache* cache,
+                       gchar** source_key)
+{
+    GdkPixbuf* pixbuf;
+    gchar* key = NULL;
+
+    if(mode == SCALING_MODE_SOURCE)
+        cover_width = cover_height = 0;
+
+    g_free(images_cache_get_key(path, mode, 0, 0, BACKGROUND_SCALER_RENDER, cover_width, cover_height, &key));
+    pixbuf = images_cache_load_source(cache, key, path, cover_width, cover_height);
+
+    if(source_key)
+        *source_key = key;
+    else
+        g_free(key);
+    return pixbuf;
+}
+
+static GdkPixbuf*
+scale_image_file(const gchar* path,
+                 ScalingMode mode,
+                 gint width, gint height,
+                 gint cover_width, gint cover_height,
+                 BackgroundScaler scaler,
+                 ImagesCache* cache)
+{
+    gchar* key = NULL;
+    gchar* source_key = NULL;
+    GdkPixbuf* pixbuf = NULL;
+
+    /* Source mode draws image as is, it must be decoded at full size */
+    if(mode == SCALING_MODE_SOURCE)
+        cover_width = cover_height = 0;
+
+    if(cache)
+    {
+        key = images_cache_get_key(path, mode, width, height, scaler, cover_width, cover_height, &source_key);
+        g_mutex_lock(&cache->lock);
+        pixbuf = images_cache_lookup(cache, key);
+        g_mutex_unlock(&cache->lock);
+        if(pixbuf)
+        {
+            g_free(source_key);
+            g_free(key);
+            return pixbuf;
+        }
+        /* Other jobs with the same file wait for this decoding instead of doing it again */
+        pixbuf = images_cache_load_source(cache, source_key, path, cover_width, cover_height);
+    }
+    else
+        pixbuf = load_image_file(path, cover_width, cover_height);
+
+    if(pixbuf)
+    {
+        GdkPixbuf* scaled = scale_image(pixbuf, mode, width, height, scaler);
+        if(cache && scaled != pixbuf)
+        {
+            g_mutex_lock(&cache->lock);
+            images_cache_insert(cache, key, scaled);
+            g_mutex_unlock(&cache->lock);
+        }
         g_object_unref(pixbuf);
         pixbuf = scaled;
     }
 
+    g_free(source_key);
     g_free(key);
 
     return pixbuf;
@@ -1575,8 +4323,14 @@ scale_image_file(const gchar* path,
 static GdkPixbuf*
 scale_image(GdkPixbuf* source,
             ScalingMode mode,
-            gint width, gint height)
+            gint width, gint height,
+            BackgroundScaler scaler)
 {
+    /* Pre-rendered variant of exact size */
+    if(mode != SCALING_MODE_SOURCE &&
+       gdk_pixbuf_get_width(source) == width && gdk_pixbuf_get_height(source) == height)
+        return g_object_ref(source);
+
     if(mode == SCALING_MODE_ZOOMED)
     {
         gint offset_x = 0;
@@ -1598,20 +4352,490 @@ scale_image(GdkPixbuf* source,
             offset_y = (height - (p_height * scale_y)) / 2;
         }
 
-        pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE,
-                                           gdk_pixbuf_get_bits_per_sample (source),
-                                           width, height);
-        gdk_pixbuf_composite(source, pixbuf, 0, 0, width, height,
-                             offset_x, offset_y, scale_x, scale_y, GDK_INTERP_BILINEAR, 0xFF);
+        /* Scaled image covers whole target, alpha channel is kept only if source has one */
+        pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(source),
+                                gdk_pixbuf_get_bits_per_sample(source),
+                                width, height);
+        scale_pixbuf(source, pixbuf, offset_x, offset_y, scale_x, scale_y, scaler);
         return pixbuf;
     }
     else if(mode == SCALING_MODE_STRETCHED)
     {
-        return gdk_pixbuf_scale_simple(source, width, height, GDK_INTERP_BILINEAR);
+        /* Same as gdk_pixbuf_scale_simple() */
+        GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(source),
+                                           gdk_pixbuf_get_bits_per_sample(source),
+                                           width, height);
+        scale_pixbuf(source, pixbuf, 0, 0,
+                     (gdouble)width/gdk_pixbuf_get_width(source),
+                     (gdouble)height/gdk_pixbuf_get_height(source),
+                     scaler);
+        return pixbuf;
     }
     return GDK_PIXBUF(g_object_ref(source));
 }
 
+/* Rows band of destination image, scaled by scaler_pool thread */
+typedef struct
+{
+    GdkPixbuf* source;
+    GdkPixbuf* dest;
+    gint y;
+    gint height;
+    gdouble offset_x, offset_y;
+    gdouble scale_x, scale_y;
+    GdkInterpType interp;
+
+    /* Shared by all tiles of the same image */
+    gint* pending;
+    GMutex* lock;
+    GCond* done;
+} ScaleTile;
+
+/* Minimal height of tile, in rows */
+static const gint SCALE_TILE_MIN_HEIGHT = 64;
+
+static void
+scale_tile_thread(ScaleTile* tile,
+                  gpointer user_data)
+{
+    /* Every destination pixel depends only on scale and offset: tiles are identical to whole image scaling */
+    gdk_pixbuf_scale(tile->source, tile->dest,
+                     0, tile->y, gdk_pixbuf_get_width(tile->dest), tile->height,
+                     tile->offset_x, tile->offset_y, tile->scale_x, tile->scale_y, tile->interp);
+
+    g_mutex_lock(tile->lock);
+    if(--*tile->pending == 0)
+        g_cond_signal(tile->done);
+    g_mutex_unlock(tile->lock);
+}
+
+static GThreadPool*
+get_scaler_pool(void)
+{
+    static GThreadPool* pool = NULL;
+
+    if(g_once_init_enter(&pool))
+    {
+        GThreadPool* new_pool = g_thread_pool_new((GFunc)scale_tile_thread, NULL,
+                                                  g_get_num_processors(), FALSE, NULL);
+        g_once_init_leave(&pool, new_pool);
+    }
+    return pool;
+}
+
+static void
+scale_pixbuf(GdkPixbuf* source,
+             GdkPixbuf* dest,
+             gdouble offset_x, gdouble offset_y,
+             gdouble scale_x, gdouble scale_y,
+             BackgroundScaler scaler)
+{
+    GdkInterpType  interp = scaler == BACKGROUND_SCALER_HYPER ? GDK_INTERP_HYPER : GDK_INTERP_BILINEAR;
+    gint           width = gdk_pixbuf_get_width(dest);
+    gint           height = gdk_pixbuf_get_height(dest);
+    gint           tiles_count;
+    gint           tile_height;
+    gint           pending;
+    GMutex         lock;
+    GCond          done;
+    ScaleTile     *tiles;
+    gint           i;
+    gint64         started = g_get_monotonic_time();
+
+    tiles_count = MIN((gint)g_get_num_processors()*2, height/SCALE_TILE_MIN_HEIGHT);
+    if(scaler == BACKGROUND_SCALER_SINGLE || tiles_count < 2)
+    {
+        gdk_pixbuf_scale(source, dest, 0, 0, width, height,
+                         offset_x, offset_y, scale_x, scale_y, interp);
+        g_debug("[Background] Image scaled to %dx%d in %.1f ms", width, height,
+                (g_get_monotonic_time() - started)/1000.0);
+        return;
+    }
+
+    g_mutex_init(&lock);
+    g_cond_init(&done);
+    pending = tiles_count;
+    tiles = g_new(ScaleTile, tiles_count);
+    tile_height = (height + tiles_count - 1)/tiles_count;
+
+    for(i = 0; i < tiles_count; ++i)
+    {
+        ScaleTile* tile = &tiles[i];
+        tile->source = source;
+        tile->dest = dest;
+        tile->y = i*tile_height;
+        tile->height = MIN(tile_height, height - tile->y);
+        tile->offset_x = offset_x;
+        tile->offset_y = offset_y;
+        tile->scale_x = scale_x;
+        tile->scale_y = scale_y;
+        tile->interp = interp;
+        tile->pending = &pending;
+        tile->lock = &lock;
+        tile->done = &done;
+
+        /* Last tile can be empty due to rounding */
+        if(tile->height <= 0)
+        {
+            g_mutex_lock(&lock);
+            pending--;
+            g_mutex_unlock(&lock);
+            continue;
+        }
+        g_thread_pool_push(get_scaler_pool(), tile, NULL);
+    }
+
+    g_mutex_lock(&lock);
+    while(pending > 0)
+        g_cond_wait(&done, &lock);
+    g_mutex_unlock(&lock);
+
+    g_free(tiles);
+    g_cond_clear(&done);
+    g_mutex_clear(&lock);
+
+    g_debug("[Background] Image scaled to %dx%d in %.1f ms (%d tiles)", width, height,
+            (g_get_monotonic_time() - started)/1000.0, tiles_count);
+}
+
+/* Copies image surface to X server, falls back to image itself on failure */
+static cairo_surface_t*
+create_server_surface(GdkScreen* screen,
+                      cairo_surface_t* image)
+{
+    cairo_surface_t *surface;
+    cairo_t         *cr;
+    cairo_content_t  content;
+    const gchar     *method = "cairo";
+    gint64           started = g_get_monotonic_time();
+    gdouble          elapsed;
+    gdouble          size;
+
+    content = cairo_image_surface_get_format(image) == CAIRO_FORMAT_RGB24 ? CAIRO_CONTENT_COLOR : CAIRO_CONTENT_COLOR_ALPHA;
+    surface = gdk_window_create_similar_surface(gdk_screen_get_root_window(screen), content,
+                                                cairo_image_surface_get_width(image),
+                                                cairo_image_surface_get_height(image));
+    if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+    {
+        cairo_surface_destroy(surface);
+        return cairo_surface_reference(image);
+    }
+
+#ifdef HAVE_XSHM
+    if(upload_image_shm(screen, surface, image))
+        method = "MIT-SHM";
+    else
+#endif
+    {
+        cr = cairo_create(surface);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(cr, image, 0, 0);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(surface);
+    }
+
+    elapsed = (g_get_monotonic_time() - started)/1000000.0;
+    size = (gdouble)cairo_image_surface_get_stride(image)*cairo_image_surface_get_height(image)/(1024*1024);
+    g_debug("[Background] Uploaded %dx%d image (%.1f MB) using %s in %.1f ms: %.0f MB/s",
+            cairo_image_surface_get_width(image), cairo_image_surface_get_height(image),
+            size, method, elapsed*1000, elapsed > 0 ? size/elapsed : 0.0);
+
+    return surface;
+}
+
+#ifdef HAVE_XSHM
+/* Puts image to server pixmap through shared memory segment.
+   Returns FALSE if server is remote or pixel formats do not match, caller must use other way then. */
+static gboolean
+upload_image_shm(GdkScreen* screen,
+                 cairo_surface_t* target,
+                 cairo_surface_t* image)
+{
+    /* -1: not checked yet, 0: unavailable, 1: available */
+    static gint      shm_available = -1;
+
+    GdkDisplay      *gdk_display = gdk_screen_get_display(screen);
+    Display         *display;
+    Visual          *visual;
+    XShmSegmentInfo  shm = {0};
+    XImage          *ximage;
+    GC               gc;
+    const guchar    *pixels;
+    gint             width;
+    gint             height;
+    gint             stride;
+    gint             depth;
+    gint             y;
+
+    if(shm_available == 0 || cairo_surface_get_type(target) != CAIRO_SURFACE_TYPE_XLIB)
+        return FALSE;
+
+    display = cairo_xlib_surface_get_display(target);
+    visual = cairo_xlib_surface_get_visual(target);
+    depth = cairo_xlib_surface_get_depth(target);
+    width = cairo_image_surface_get_width(image);
+    height = cairo_image_surface_get_height(image);
+    stride = cairo_image_surface_get_stride(image);
+
+    if(shm_available == -1)
+    {
+        shm_available = XShmQueryExtension(display) ? 1 : 0;
+        if(!shm_available)
+        {
+            g_debug("[Background] MIT-SHM extension is not available");
+            return FALSE;
+        }
+    }
+
+    /* Pixels are copied as is: server must use the same layout as cairo */
+    if(!visual || visual->red_mask != 0xff0000 || visual->green_mask != 0x00ff00 || visual->blue_mask != 0x0000ff ||
+       ImageByteOrder(display) != (G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst : MSBFirst) ||
+       (depth == 24 && cairo_image_surface_get_format(image) != CAIRO_FORMAT_RGB24) ||
+       (depth == 32 && cairo_image_surface_get_format(image) != CAIRO_FORMAT_ARGB32) ||
+       (depth != 24 && depth != 32))
+        return FALSE;
+
+    ximage = XShmCreateImage(display, visual, depth, ZPixmap, NULL, &shm, width, height);
+    if(!ximage)
+        return FALSE;
+    if(ximage->bits_per_pixel != 32)
+    {
+        XDestroyImage(ximage);
+        return FALSE;
+    }
+
+    shm.shmid = shmget(IPC_PRIVATE, (gsize)ximage->bytes_per_line*ximage->height, IPC_CREAT | 0600);
+    if(shm.shmid < 0)
+    {
+        XDestroyImage(ximage);
+        return FALSE;
+    }
+    shm.shmaddr = ximage->data = shmat(shm.shmid, NULL, 0);
+    shm.readOnly = True;
+    if(shm.shmaddr == (gpointer)-1)
+    {
+        shmctl(shm.shmid, IPC_RMID, NULL);
+        XDestroyImage(ximage);
+        return FALSE;
+    }
+
+    cairo_surface_flush(image);
+    pixels = cairo_image_surface_get_data(image);
+    for(y = 0; y < height; ++y)
+        memcpy(ximage->data + (gsize)y*ximage->bytes_per_line, pixels + (gsize)y*stride, (gsize)width*4);
+
+    /* Attaching fails for remote servers */
+    gdk_x11_display_error_trap_push(gdk_display);
+    XShmAttach(display, &shm);
+    XSync(display, False);
+    if(gdk_x11_display_error_trap_pop(gdk_display))
+    {
+        g_debug("[Background] Failed to attach MIT-SHM segment, server is not local");
+        shm_available = 0;
+        shmdt(shm.shmaddr);
+        shmctl(shm.shmid, IPC_RMID, NULL);
+        XDestroyImage(ximage);
+        return FALSE;
+    }
+    /* Segment is destroyed when both sides are detached */
+    shmctl(shm.shmid, IPC_RMID, NULL);
+
+    gc = XCreateGC(display, cairo_xlib_surface_get_drawable(target), 0, NULL);
+    XShmPutImage(display, cairo_xlib_surface_get_drawable(target), gc, ximage,
+                 0, 0, 0, 0, width, height, False);
+    XFreeGC(display, gc);
+    /* Wait until server has read segment */
+    XSync(display, False);
+
+    XShmDetach(display, &shm);
+    XDestroyImage(ximage);
+    shmdt(shm.shmaddr);
+
+    cairo_surface_mark_dirty(target);
+    return TRUE;
+}
+#endif
+
+/* X server scaling needs RENDER, and it is only worth it when sources are not sent over network */
+static gboolean
+render_scaling_available(GdkDisplay* gdk_display)
+{
+    static gint  available = -1;
+    Display     *display;
+    const gchar *name;
+    gint         opcode;
+    gint         event_base;
+    gint         error_base;
+
+    if(available != -1)
+        return available;
+
+    if(!GDK_IS_X11_DISPLAY(gdk_display))
+    {
+        g_warning("[Background] X server scaling requires X11 display, using bilinear scaler");
+        available = 0;
+        return available;
+    }
+
+    display = gdk_x11_display_get_xdisplay(gdk_display);
+    name = DisplayString(display);
+    if(!XQueryExtension(display, "RENDER", &opcode, &event_base, &error_base))
+    {
+        g_warning("[Background] RENDER extension is not available, using bilinear scaler");
+        available = 0;
+    }
+    else if(!name || !(name[0] == ':' || g_str_has_prefix(name, "unix:")))
+    {
+        g_warning("[Background] Display %s is not local, using bilinear scaler", name ? name : "");
+        available = 0;
+    }
+    else
+        available = 1;
+
+    return available;
+}
+
+/* Scales server-side source to new server surface, cairo-xlib uses RENDER picture transform for it */
+static cairo_surface_t*
+create_scaled_server_surface(GdkScreen* screen,
+                             cairo_surface_t* source,
+                             ScalingMode mode,
+                             gint width, gint height)
+{
+    cairo_surface_t *surface;
+    cairo_t         *cr;
+    gint             source_width;
+    gint             source_height;
+    gdouble          scale_x;
+    gdouble          scale_y;
+    gdouble          offset_x = 0;
+    gdouble          offset_y = 0;
+    gint64           started = g_get_monotonic_time();
+
+    if(cairo_surface_get_type(source) == CAIRO_SURFACE_TYPE_XLIB)
+    {
+        source_width = cairo_xlib_surface_get_width(source);
+        source_height = cairo_xlib_surface_get_height(source);
+    }
+    else
+    {
+        source_width = cairo_image_surface_get_width(source);
+        source_height = cairo_image_surface_get_height(source);
+    }
+
+    if(mode == SCALING_MODE_SOURCE)
+        return cairo_surface_reference(source);
+
+    /* Same geometry as scale_image() */
+    scale_x = (gdouble)width/source_width;
+    scale_y = (gdouble)height/source_height;
+    if(mode == SCALING_MODE_ZOOMED)
+    {
+        if(scale_x < scale_y)
+        {
+            scale_x = scale_y;
+            offset_x = (gint)((width - (source_width*scale_x))/2);
+        }
+        else
+        {
+            scale_y = scale_x;
+            offset_y = (gint)((height - (source_height*scale_y))/2);
+        }
+    }
+
+    surface = gdk_window_create_similar_surface(gdk_screen_get_root_window(screen),
+                                                cairo_surface_get_content(source),
+                                                width, height);
+    cr = cairo_create(surface);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_translate(cr, offset_x, offset_y);
+    cairo_scale(cr, scale_x, scale_y);
+    cairo_set_source_surface(cr, source, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+    cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+
+    g_debug("[Background] Image scaled by X server from %dx%d to %dx%d in %.1f ms",
+            source_width, source_height, width, height, (g_get_monotonic_time() - started)/1000.0);
+
+    return surface;
+}
+
+/* Compares X server scaling result with CPU scaler, falls back to CPU scaler if difference is too big */
+static gboolean
+compare_render_scaling(cairo_surface_t* result,
+                       cairo_surface_t* reference)
+{
+    /* Maximal acceptable difference of color channel */
+    static const gint   TOLERANCE = 8;
+    /* Maximal acceptable part of pixels beyond tolerance */
+    static const gdouble MAX_MISMATCH = 0.01;
+
+    cairo_surface_t    *readback;
+    cairo_t            *cr;
+    const guchar       *a;
+    const guchar       *b;
+    gint                width = cairo_image_surface_get_width(reference);
+    gint                height = cairo_image_surface_get_height(reference);
+    gint                stride_a;
+    gint                stride_b;
+    /* Padding byte of RGB24 pixels is undefined, X server readback does not have to match GDK's 0xff */
+    guint32             mask = cairo_image_surface_get_format(reference) == CAIRO_FORMAT_ARGB32 ?
+                               0xffffffff : 0x00ffffff;
+    gint                max_diff = 0;
+    gsize               mismatched = 0;
+    gint                x, y, c;
+
+    readback = cairo_image_surface_create(cairo_image_surface_get_format(reference), width, height);
+    cr = cairo_create(readback);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cr, result, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(readback);
+    cairo_surface_flush(reference);
+
+    a = cairo_image_surface_get_data(readback);
+    b = cairo_image_surface_get_data(reference);
+    stride_a = cairo_image_surface_get_stride(readback);
+    stride_b = cairo_image_surface_get_stride(reference);
+
+    for(y = 0; y < height; ++y)
+    {
+        const guint32* row_a = (const guint32*)(a + (gsize)y*stride_a);
+        const guint32* row_b = (const guint32*)(b + (gsize)y*stride_b);
+
+        for(x = 0; x < width; ++x)
+        {
+            guint32 pixel_a = row_a[x] & mask;
+            guint32 pixel_b = row_b[x] & mask;
+            gint    pixel_diff = 0;
+
+            for(c = 0; c < 32; c += 8)
+                pixel_diff = MAX(pixel_diff, ABS((gint)((pixel_a >> c) & 0xff) - (gint)((pixel_b >> c) & 0xff)));
+            max_diff = MAX(max_diff, pixel_diff);
+            if(pixel_diff > TOLERANCE)
+                mismatched++;
+        }
+    }
+
+    cairo_surface_destroy(readback);
+
+    if(width > 0 && height > 0 && (gdouble)mismatched/((gsize)width*height) > MAX_MISMATCH)
+    {
+        g_warning("[Background] X server scaling differs from CPU scaler: %" G_GSIZE_FORMAT " of %d pixels, max difference %d",
+                  mismatched, width*height, max_diff);
+        return FALSE;
+    }
+
+    g_debug("[Background] X server scaling matches CPU scaler: %" G_GSIZE_FORMAT " pixels beyond tolerance, max difference %d",
+            mismatched, max_diff);
+    return TRUE;
+}
+
 /* The following code for setting a RetainPermanent background pixmap was taken
    originally from Gnome, with some fixes from MATE. see:
    https://github.com/mate-desktop/mate-desktop/blob/master/libmate-desktop/mate-bg.c */
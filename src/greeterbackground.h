@@ -39,6 +39,14 @@ typedef enum
     TRANSITION_EFFECT_NONE,
 } TransitionEffect;
 
+typedef enum
+{
+    BACKGROUND_SCALER_BILINEAR,
+    BACKGROUND_SCALER_HYPER,
+    BACKGROUND_SCALER_SINGLE,
+    BACKGROUND_SCALER_RENDER
+} BackgroundScaler;
+
 typedef struct _GreeterBackground           GreeterBackground;
 typedef struct _GreeterBackgroundClass      GreeterBackgroundClass;
 
@@ -53,14 +61,34 @@ void greeter_background_set_monitor_config          (GreeterBackground* backgrou
                                                      gint user_bg,
                                                      gint laptop,
                                                      gint transition_duration,
-                                                     TransitionType transition_type);
+                                                     TransitionType transition_type,
+                                                     gint blur,
+                                                     gint dim);
 void greeter_background_remove_monitor_config       (GreeterBackground* background,
                                                      const gchar* name);
+void greeter_background_set_separate_window         (GreeterBackground* background,
+                                                     gboolean enabled);
+void greeter_background_set_paint_stats             (GreeterBackground* background,
+                                                     gboolean enabled);
+void greeter_background_set_monitors_settle_delay   (GreeterBackground* background,
+                                                     gint delay);
+void greeter_background_set_cache_size              (GreeterBackground* background,
+                                                     gint size_mb);
+void greeter_background_set_disk_cache              (GreeterBackground* background,
+                                                     const gchar* path,
+                                                     gint size_mb);
+void greeter_background_set_scaler                  (GreeterBackground* background,
+                                                     BackgroundScaler scaler);
 gchar** greeter_background_get_configured_monitors  (GreeterBackground* background);
 void greeter_background_connect                     (GreeterBackground* background,
                                                      GdkScreen* screen);
 void greeter_background_set_custom_background       (GreeterBackground* background,
                                                      const gchar* path);
+gboolean greeter_background_is_custom_background_cached(GreeterBackground* background,
+                                                        const gchar* path);
+void greeter_background_prefetch                    (GreeterBackground* background,
+                                                     const gchar* path);
+void greeter_background_cancel_prefetch             (GreeterBackground* background);
 void greeter_background_save_xroot                  (GreeterBackground* background);
 const GdkRectangle* greeter_background_get_active_monitor_geometry(GreeterBackground* background);
 void greeter_background_add_accel_group             (GreeterBackground* background,
@@ -8,7 +8,11 @@
  * license.
  */
 
+#include <string.h>
+#include <sys/stat.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
 
 #include "greeterconfiguration.h"
 
@@ -16,22 +20,153 @@
 static GKeyFile* greeter_config = NULL;
 static GKeyFile* state_config = NULL;
 static gchar* state_filename = NULL;
+static gchar* cache_dir = NULL;
+static ConfigValues config_values;
+/* Directories containing "lightdm/lightdm-gtk-greeter.conf(.d)", in order of priority */
+static GPtrArray* config_base_dirs = NULL;
+
+/* Configuration is reloaded after CONFIG_RELOAD_DELAY (ms) without file changes */
+static const guint CONFIG_RELOAD_DELAY = 500;
+static GPtrArray* config_monitors = NULL;
+static guint config_reload_id = 0;
+static ConfigReloadedFunc config_reloaded_func = NULL;
+static gpointer config_reloaded_data = NULL;
+/* "group" and "group\nkey" of changed values, valid during config_reloaded_func call */
+static GHashTable* config_changes = NULL;
+
+/* Collected by config_dump(): files timings and origin of every key */
+typedef struct
+{
+    /* "group\nkey" => path of file that set the value */
+    GHashTable* sources;
+    GString* files;
+    guint n_paths;
+    gint64 scan_time;
+} ConfigProfile;
+
+static ConfigProfile* config_profile = NULL;
+
+/* Merged configuration is cached in binary form, validated by stat() of every contributing path */
+#define CONFIG_CACHE_FILENAME           "config.cache"
+#define CONFIG_CACHE_VERSION            1
+static const gchar CONFIG_CACHE_MAGIC[4] = {'L', 'G', 'C', 'C'};
+
+/* Cache layout: header, sources[n_sources], strings[strings_length], data[data_length] */
+typedef struct
+{
+    gchar magic[4];
+    guint32 version;
+    guint32 n_sources;
+    guint32 strings_length;
+    guint32 data_length;
+    guint32 reserved;
+} ConfigCacheHeader;
+
+/* st_mode is 0 for missing paths, path is offset in strings */
+typedef struct
+{
+    gint64 mtime;
+    gint64 size;
+    guint64 inode;
+    guint32 mode;
+    guint32 path;
+} ConfigCacheSource;
+
+typedef struct
+{
+    GArray* entries;
+    /* Starts with cache key: list of base directories */
+    GString* strings;
+} ConfigSources;
+
+/* State changes are written to disk by worker thread after STATE_SAVE_DELAY (ms) without changes */
+static const guint STATE_SAVE_DELAY = 500;
+
+typedef struct
+{
+    guint64 generation;
+    gchar* data;
+    gsize length;
+} StateSnapshot;
+
+static guint state_save_id = 0;
+/* Number of config_set_*() calls coalesced into next write */
+static guint state_changes = 0;
+/* Last serialized snapshot, only newer snapshots are written */
+static guint64 state_generation = 0;
+static GThreadPool* state_writer = NULL;
+/* Held while writing, protects state_written_generation */
+static GMutex state_write_lock;
+static guint64 state_written_generation = 0;
 
 static GKeyFile* get_file_for_group (const gchar** group);
-static void save_key_file           (GKeyFile* config, const gchar* path);
+static guint32 stat_source          (const gchar* path, ConfigCacheSource* source);
+static guint32 add_source           (ConfigSources* sources, const gchar* path);
+static GKeyFile* merge_config_files (GList* files);
+static void profile_set_source      (const gchar* group, const gchar* key, const gchar* path);
+static void profile_remove_group    (const gchar* group);
+static GKeyFile* read_config        (gboolean use_cache);
+static void diff_config             (GKeyFile* config, GKeyFile* other, GHashTable* changes);
+static void config_file_changed_cb  (GFileMonitor* monitor, GFile* file, GFile* other_file,
+                                     GFileMonitorEvent event, gpointer user_data);
+static gboolean config_reload_cb    (gpointer user_data);
+static GKeyFile* load_cached_config (const gchar* path, const gchar* key);
+static void save_cached_config      (const gchar* path, GKeyFile* config, ConfigSources* sources);
+static void compile_values          (void);
+static void schedule_state_save     (void);
+static gboolean state_save_cb       (gpointer user_data);
+static StateSnapshot* state_snapshot_new (void);
+static void state_snapshot_free     (StateSnapshot* snapshot);
+static void state_snapshot_write    (StateSnapshot* snapshot);
+static void state_writer_thread     (StateSnapshot* snapshot, gpointer user_data);
 static gboolean get_int             (GKeyFile* config, const gchar* group, const gchar* key, gint* out);
 static gboolean get_bool            (GKeyFile* config, const gchar* group, const gchar* key, gboolean* out);
 
 /* Implementation */
 
+static guint32
+stat_source(const gchar* path, ConfigCacheSource* source)
+{
+    GStatBuf st;
+
+    memset(source, 0, sizeof(*source));
+    if(g_stat(path, &st) == 0)
+    {
+        source->mtime = st.st_mtime;
+        source->size = st.st_size;
+        source->inode = st.st_ino;
+        source->mode = st.st_mode;
+    }
+    return source->mode;
+}
+
+/* Records path state before it is read, so concurrent changes invalidate cache */
+static guint32
+add_source(ConfigSources* sources, const gchar* path)
+{
+    ConfigCacheSource source;
+
+    stat_source(path, &source);
+    source.path = sources->strings->len;
+    g_string_append_len(sources->strings, path, strlen(path) + 1);
+    g_array_append_val(sources->entries, source);
+    return source.mode;
+}
+
 static GList*
-append_directory_content(GList* files, const gchar* path)
+append_directory_content(GList* files, ConfigSources* sources, const gchar* path)
 {
     GError *error = NULL;
     GList  *content = NULL;
     GList  *list_iter = NULL;
-    gchar  *full_path = g_build_filename(path, "lightdm", "lightdm-gtk-greeter.conf.d", NULL);
-    GDir   *dir = g_dir_open(full_path, 0, &error);
+    gchar  *lightdm_path = g_build_filename(path, "lightdm", NULL);
+    gchar  *full_path = g_build_filename(lightdm_path, "lightdm-gtk-greeter.conf.d", NULL);
+    GDir   *dir;
+
+    /* Directory mtimes cover added and removed files */
+    add_source(sources, lightdm_path);
+    add_source(sources, full_path);
+    dir = g_dir_open(full_path, 0, &error);
 
     if(error && !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
         g_warning("[Configuration] Failed to read configuration directory '%s': %s", full_path, error->message);
@@ -52,11 +187,11 @@ append_directory_content(GList* files, const gchar* path)
             content = g_list_sort(content, (GCompareFunc)g_strcmp0);
     }
 
-    content = g_list_append(content, g_build_filename(path, "lightdm", "lightdm-gtk-greeter.conf", NULL));
+    content = g_list_append(content, g_build_filename(lightdm_path, "lightdm-gtk-greeter.conf", NULL));
 
     for(list_iter = content; list_iter; list_iter = g_list_next(list_iter))
     {
-        if(g_file_test(list_iter->data, G_FILE_TEST_IS_REGULAR))
+        if(S_ISREG(add_source(sources, list_iter->data)))
             files = g_list_prepend(files, list_iter->data);
         else
             g_free(list_iter->data);
@@ -64,64 +199,44 @@ append_directory_content(GList* files, const gchar* path)
 
     g_list_free(content);
     g_free(full_path);
+    g_free(lightdm_path);
     return files;
 }
 
-void
-config_init(void)
+static GKeyFile*
+merge_config_files(GList* files)
 {
-    GKeyFile            *tmp_config = NULL;
-    GError              *error = NULL;
-    GList               *files = NULL;
-    GList               *file_iter = NULL;
-    const gchar* const  *dirs;
-    const gchar         *xdg_seat;
-    gchar               *state_config_dir;
-    gchar               *config_path_tmp;
-    gchar               *config_path;
-    gint                i;
-
-    xdg_seat = g_getenv ("XDG_SEAT");
-    if (xdg_seat != NULL && (*xdg_seat == '\0' || g_strcmp0 (xdg_seat, "seat0") == 0))
-        xdg_seat = NULL;
-
-    state_config_dir = g_build_filename(g_get_user_cache_dir(), "lightdm-gtk-greeter", xdg_seat, NULL);
-    state_filename = g_build_filename(state_config_dir, "state", NULL);
-    g_mkdir_with_parents(state_config_dir, 0775);
-    g_free(state_config_dir);
-
-    state_config = g_key_file_new();
-    g_key_file_load_from_file(state_config, state_filename, G_KEY_FILE_NONE, &error);
-    if (error && !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
-        g_warning("[Configuration] Failed to load state from %s: %s", state_filename, error->message);
-    g_clear_error(&error);
-
-    dirs = g_get_system_data_dirs();
-    for(i = 0; dirs[i]; ++i)
-        files = append_directory_content(files, dirs[i]);
-
-    dirs = g_get_system_config_dirs();
-    for(i = 0; dirs[i]; ++i)
-        files = append_directory_content(files, dirs[i]);
-
-    config_path_tmp = g_path_get_dirname(CONFIG_FILE);
-    config_path = g_path_get_dirname(config_path_tmp);
-    files = append_directory_content(files, config_path);
-    g_free(config_path_tmp);
-    g_free(config_path);
-
-    files = g_list_reverse(files);
+    GKeyFile    *config = NULL;
+    GKeyFile    *tmp_config = NULL;
+    GError      *error = NULL;
+    GList       *file_iter = NULL;
 
     for(file_iter = files; file_iter; file_iter = g_list_next(file_iter))
     {
         const gchar  *path = file_iter->data;
         gchar       **group_iter = NULL;
         gchar       **groups;
+        gchar        *data = NULL;
+        gsize         length = 0;
+        gint64        start_time;
+        gint64        read_time;
+        gboolean      loaded;
 
         if(!tmp_config)
             tmp_config = g_key_file_new();
 
-        if(!g_key_file_load_from_file(tmp_config, path, G_KEY_FILE_NONE, &error))
+        start_time = g_get_monotonic_time();
+        loaded = g_file_get_contents(path, &data, &length, &error);
+        read_time = g_get_monotonic_time();
+        loaded = loaded && g_key_file_load_from_data(tmp_config, data, length, G_KEY_FILE_NONE, &error);
+        g_free(data);
+
+        if(config_profile)
+            g_string_append_printf(config_profile->files, "#   %8.3f %8.3f  %s%s\n",
+                                   (read_time - start_time)/1000.0, (g_get_monotonic_time() - read_time)/1000.0,
+                                   path, loaded ? "" : " (failed)");
+
+        if(!loaded)
         {
             if(error)
             {
@@ -134,10 +249,25 @@ config_init(void)
         }
         g_message("[Configuration] Reading file: %s", path);
 
-        if(!greeter_config)
+        if(!config)
         {
-            greeter_config = tmp_config;
+            config = tmp_config;
             tmp_config = NULL;
+
+            if(config_profile)
+            {
+                groups = g_key_file_get_groups(config, NULL);
+                for(group_iter = groups; *group_iter; ++group_iter)
+                {
+                    gchar **keys = g_key_file_get_keys(config, *group_iter, NULL, NULL);
+                    gchar **key_iter;
+
+                    for(key_iter = keys; key_iter && *key_iter; ++key_iter)
+                        profile_set_source(*group_iter, *key_iter, path);
+                    g_strfreev(keys);
+                }
+                g_strfreev(groups);
+            }
             continue;
         }
 
@@ -148,7 +278,8 @@ config_init(void)
             gchar **keys = NULL;
             if(**group_iter == '-')
             {
-                g_key_file_remove_group(greeter_config, *group_iter + 1, NULL);
+                g_key_file_remove_group(config, *group_iter + 1, NULL);
+                profile_remove_group(*group_iter + 1);
                 continue;
             }
 
@@ -159,14 +290,16 @@ config_init(void)
 
                 if(**key_iter == '-')
                 {
-                    g_key_file_remove_key(greeter_config, *group_iter, *key_iter + 1, NULL);
+                    g_key_file_remove_key(config, *group_iter, *key_iter + 1, NULL);
+                    profile_set_source(*group_iter, *key_iter + 1, NULL);
                     continue;
                 }
 
                 value = g_key_file_get_value(tmp_config, *group_iter, *key_iter, NULL);
                 if(value)
                 {
-                    g_key_file_set_value(greeter_config, *group_iter, *key_iter, value);
+                    g_key_file_set_value(config, *group_iter, *key_iter, value);
+                    profile_set_source(*group_iter, *key_iter, path);
                     g_free(value);
                 }
             }
@@ -176,10 +309,487 @@ config_init(void)
     }
     if (tmp_config)
         g_key_file_unref(tmp_config);
-    g_list_free_full(files, g_free);
 
-    if(!greeter_config)
-        greeter_config = g_key_file_new();
+    return config;
+}
+
+/* Records file that set the key, NULL path if key is removed */
+static void
+profile_set_source(const gchar* group, const gchar* key, const gchar* path)
+{
+    gchar *name;
+
+    if(!config_profile)
+        return;
+
+    name = g_strdup_printf("%s\n%s", group, key);
+    if(path)
+        g_hash_table_insert(config_profile->sources, name, g_strdup(path));
+    else
+    {
+        g_hash_table_remove(config_profile->sources, name);
+        g_free(name);
+    }
+}
+
+static void
+profile_remove_group(const gchar* group)
+{
+    GHashTableIter  iter;
+    gpointer        name;
+    gchar          *prefix;
+
+    if(!config_profile)
+        return;
+
+    prefix = g_strdup_printf("%s\n", group);
+    g_hash_table_iter_init(&iter, config_profile->sources);
+    while(g_hash_table_iter_next(&iter, &name, NULL))
+        if(g_str_has_prefix(name, prefix))
+            g_hash_table_iter_remove(&iter);
+    g_free(prefix);
+}
+
+static GKeyFile*
+load_cached_config(const gchar* path, const gchar* key)
+{
+    GMappedFile             *mapped;
+    GError                  *error = NULL;
+    GKeyFile                *config = NULL;
+    const ConfigCacheHeader *header;
+    const ConfigCacheSource *sources;
+    const gchar             *strings;
+    const gchar             *contents;
+    gsize                   length;
+    guint32                 i;
+
+    mapped = g_mapped_file_new(path, FALSE, &error);
+    if(!mapped)
+    {
+        if(!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_debug("[Configuration] Failed to open configuration cache '%s': %s", path, error->message);
+        g_clear_error(&error);
+        return NULL;
+    }
+
+    contents = g_mapped_file_get_contents(mapped);
+    length = g_mapped_file_get_length(mapped);
+    header = (const ConfigCacheHeader*)contents;
+
+    if(length < sizeof(*header) ||
+       memcmp(header->magic, CONFIG_CACHE_MAGIC, sizeof(CONFIG_CACHE_MAGIC)) != 0 ||
+       header->version != CONFIG_CACHE_VERSION ||
+       header->n_sources > (length - sizeof(*header))/sizeof(*sources) ||
+       (gsize)header->strings_length + header->data_length !=
+            length - sizeof(*header) - header->n_sources*sizeof(*sources) ||
+       header->strings_length == 0)
+    {
+        g_debug("[Configuration] Ignoring invalid configuration cache '%s'", path);
+        goto out;
+    }
+
+    sources = (const ConfigCacheSource*)(contents + sizeof(*header));
+    strings = (const gchar*)(sources + header->n_sources);
+
+    if(strings[header->strings_length - 1] != '\0' || g_strcmp0(strings, key) != 0)
+        goto out;
+
+    for(i = 0; i < header->n_sources; ++i)
+    {
+        ConfigCacheSource current;
+
+        if(sources[i].path >= header->strings_length)
+            goto out;
+
+        stat_source(strings + sources[i].path, &current);
+        if(current.mode != sources[i].mode || current.mtime != sources[i].mtime ||
+           current.size != sources[i].size || current.inode != sources[i].inode)
+        {
+            g_debug("[Configuration] Configuration cache is outdated: %s", strings + sources[i].path);
+            goto out;
+        }
+    }
+
+    config = g_key_file_new();
+    if(!g_key_file_load_from_data(config, strings + header->strings_length, header->data_length,
+                                  G_KEY_FILE_NONE, &error))
+    {
+        g_debug("[Configuration] Failed to parse configuration cache '%s': %s", path, error->message);
+        g_clear_error(&error);
+        g_clear_pointer(&config, g_key_file_unref);
+    }
+    else
+        g_message("[Configuration] Using cached configuration: %s", path);
+
+out:
+    g_mapped_file_unref(mapped);
+    return config;
+}
+
+static void
+save_cached_config(const gchar* path, GKeyFile* config, ConfigSources* sources)
+{
+    ConfigCacheHeader   header;
+    GByteArray          *buffer;
+    GError              *error = NULL;
+    gchar               *data;
+    gsize               data_length;
+    gint64              now = g_get_real_time()/G_USEC_PER_SEC;
+    guint               i;
+
+    /* mtime has one second resolution: files changed within last second can change again unnoticed */
+    for(i = 0; i < sources->entries->len; ++i)
+    {
+        if(g_array_index(sources->entries, ConfigCacheSource, i).mtime >= now - 1)
+        {
+            g_debug("[Configuration] Configuration was changed recently, cache is not updated");
+            return;
+        }
+    }
+
+    data = g_key_file_to_data(config, &data_length, NULL);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONFIG_CACHE_MAGIC, sizeof(CONFIG_CACHE_MAGIC));
+    header.version = CONFIG_CACHE_VERSION;
+    header.n_sources = sources->entries->len;
+    header.strings_length = sources->strings->len;
+    header.data_length = data_length;
+
+    buffer = g_byte_array_sized_new(sizeof(header) + sources->entries->len*sizeof(ConfigCacheSource) +
+                                    sources->strings->len + data_length);
+    g_byte_array_append(buffer, (const guint8*)&header, sizeof(header));
+    g_byte_array_append(buffer, (const guint8*)sources->entries->data,
+                        sources->entries->len*sizeof(ConfigCacheSource));
+    g_byte_array_append(buffer, (const guint8*)sources->strings->str, sources->strings->len);
+    g_byte_array_append(buffer, (const guint8*)data, data_length);
+
+    if(!g_file_set_contents(path, (const gchar*)buffer->data, buffer->len, &error))
+    {
+        g_warning("[Configuration] Failed to write configuration cache '%s': %s", path, error->message);
+        g_clear_error(&error);
+    }
+
+    g_byte_array_unref(buffer);
+    g_free(data);
+}
+
+/* Merges all configuration files, merged result is taken from cache if it is still valid */
+static GKeyFile*
+read_config(gboolean use_cache)
+{
+    GKeyFile            *config = NULL;
+    GList               *files = NULL;
+    GString             *cache_key;
+    ConfigSources       sources;
+    gchar               *config_cache_path;
+    guint               i;
+
+    cache_key = g_string_new(NULL);
+    for(i = 0; i < config_base_dirs->len; ++i)
+        g_string_append_printf(cache_key, "%s\n", (const gchar*)config_base_dirs->pdata[i]);
+
+    config_cache_path = g_build_filename(cache_dir, CONFIG_CACHE_FILENAME, NULL);
+    if(use_cache && !config_profile)
+        config = load_cached_config(config_cache_path, cache_key->str);
+
+    if(!config)
+    {
+        gint64 scan_time = g_get_monotonic_time();
+
+        sources.entries = g_array_new(FALSE, FALSE, sizeof(ConfigCacheSource));
+        sources.strings = g_string_new_len(cache_key->str, cache_key->len + 1);
+
+        for(i = 0; i < config_base_dirs->len; ++i)
+            files = append_directory_content(files, &sources, config_base_dirs->pdata[i]);
+        files = g_list_reverse(files);
+
+        if(config_profile)
+        {
+            config_profile->n_paths = sources.entries->len;
+            config_profile->scan_time = g_get_monotonic_time() - scan_time;
+        }
+
+        config = merge_config_files(files);
+        g_list_free_full(files, g_free);
+
+        if(!config)
+            config = g_key_file_new();
+
+        if(!config_profile)
+            save_cached_config(config_cache_path, config, &sources);
+
+        g_array_unref(sources.entries);
+        g_string_free(sources.strings, TRUE);
+    }
+
+    g_free(config_cache_path);
+    g_string_free(cache_key, TRUE);
+    return config;
+}
+
+void
+config_init(void)
+{
+    GError              *error = NULL;
+    const gchar* const  *dirs;
+    const gchar         *xdg_seat;
+    gchar               *config_path_tmp;
+    guint               i;
+
+    xdg_seat = g_getenv ("XDG_SEAT");
+    if (xdg_seat != NULL && (*xdg_seat == '\0' || g_strcmp0 (xdg_seat, "seat0") == 0))
+        xdg_seat = NULL;
+
+    cache_dir = g_build_filename(g_get_user_cache_dir(), "lightdm-gtk-greeter", xdg_seat, NULL);
+    state_filename = g_build_filename(cache_dir, "state", NULL);
+    g_mkdir_with_parents(cache_dir, 0775);
+
+    state_config = g_key_file_new();
+    g_key_file_load_from_file(state_config, state_filename, G_KEY_FILE_NONE, &error);
+    if (error && !g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning("[Configuration] Failed to load state from %s: %s", state_filename, error->message);
+    g_clear_error(&error);
+
+    config_base_dirs = g_ptr_array_new_with_free_func(g_free);
+
+    dirs = g_get_system_data_dirs();
+    for(i = 0; dirs[i]; ++i)
+        g_ptr_array_add(config_base_dirs, g_strdup(dirs[i]));
+
+    dirs = g_get_system_config_dirs();
+    for(i = 0; dirs[i]; ++i)
+        g_ptr_array_add(config_base_dirs, g_strdup(dirs[i]));
+
+    config_path_tmp = g_path_get_dirname(CONFIG_FILE);
+    g_ptr_array_add(config_base_dirs, g_path_get_dirname(config_path_tmp));
+    g_free(config_path_tmp);
+
+    greeter_config = read_config(TRUE);
+
+    compile_values();
+}
+
+#define CONFIG_GET_BOOL get_bool
+#define CONFIG_GET_INT  get_int
+
+/* Invalid values are reported here once, accessors do not parse anything */
+static void
+compile_values(void)
+{
+#define CONFIG_COMPILE_FIELD(field, key, type, fallback) \
+    if(!CONFIG_GET_##type(greeter_config, CONFIG_GROUP_DEFAULT, key, &config_values.field)) \
+        config_values.field = fallback;
+    CONFIG_TYPED_KEYS(CONFIG_COMPILE_FIELD)
+#undef CONFIG_COMPILE_FIELD
+}
+
+void
+config_dump(void)
+{
+    ConfigProfile   profile;
+    gint64          start_time;
+    gint64          total_time;
+    gchar         **groups;
+    gchar         **group_iter;
+
+    profile.sources = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    profile.files = g_string_new(NULL);
+    profile.n_paths = 0;
+    profile.scan_time = 0;
+
+    config_profile = &profile;
+    start_time = g_get_monotonic_time();
+    config_init();
+    total_time = g_get_monotonic_time() - start_time;
+    config_profile = NULL;
+
+    g_print("# Files (read ms, parse ms):\n%s", profile.files->str);
+    g_print("# Scan: %u paths in %.3f ms\n", profile.n_paths, profile.scan_time/1000.0);
+    g_print("# Total: %.3f ms\n", total_time/1000.0);
+
+    groups = g_key_file_get_groups(greeter_config, NULL);
+    for(group_iter = groups; *group_iter; ++group_iter)
+    {
+        gchar **keys = g_key_file_get_keys(greeter_config, *group_iter, NULL, NULL);
+        gchar **key_iter;
+
+        g_print("\n[%s]\n", *group_iter);
+        for(key_iter = keys; key_iter && *key_iter; ++key_iter)
+        {
+            gchar *name = g_strdup_printf("%s\n%s", *group_iter, *key_iter);
+            gchar *value = g_key_file_get_value(greeter_config, *group_iter, *key_iter, NULL);
+            const gchar *source = g_hash_table_lookup(profile.sources, name);
+
+            g_print("# %s\n%s=%s\n", source ? source : "<unknown>", *key_iter, value);
+            g_free(value);
+            g_free(name);
+        }
+        g_strfreev(keys);
+    }
+    g_strfreev(groups);
+
+    g_hash_table_unref(profile.sources);
+    g_string_free(profile.files, TRUE);
+}
+
+const ConfigValues*
+config_get_values(void)
+{
+    return &config_values;
+}
+
+void
+config_watch(ConfigReloadedFunc callback, gpointer user_data)
+{
+    guint i;
+
+    config_reloaded_func = callback;
+    config_reloaded_data = user_data;
+
+    if(config_monitors)
+        return;
+
+    config_monitors = g_ptr_array_new_with_free_func(g_object_unref);
+    for(i = 0; i < config_base_dirs->len; ++i)
+    {
+        /* "lightdm" directory: main file and appearance of conf.d directory */
+        gchar *paths[] = {g_build_filename(config_base_dirs->pdata[i], "lightdm", NULL),
+                          g_build_filename(config_base_dirs->pdata[i], "lightdm", "lightdm-gtk-greeter.conf.d", NULL)};
+        guint j;
+
+        for(j = 0; j < G_N_ELEMENTS(paths); ++j)
+        {
+            GError       *error = NULL;
+            GFile        *file = g_file_new_for_path(paths[j]);
+            GFileMonitor *monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, &error);
+
+            if(monitor)
+            {
+                g_signal_connect(monitor, "changed", G_CALLBACK(config_file_changed_cb), NULL);
+                g_ptr_array_add(config_monitors, monitor);
+            }
+            else
+            {
+                g_warning("[Configuration] Failed to watch directory '%s': %s", paths[j], error->message);
+                g_clear_error(&error);
+            }
+
+            g_object_unref(file);
+            g_free(paths[j]);
+        }
+    }
+    g_debug("[Configuration] Watching %u configuration directories", config_monitors->len);
+}
+
+gboolean
+config_key_changed(const gchar* group, const gchar* key)
+{
+    gboolean changed;
+    gchar *name;
+
+    if(!config_changes)
+        return FALSE;
+
+    name = g_strdup_printf("%s\n%s", group ? group : CONFIG_GROUP_DEFAULT, key);
+    changed = g_hash_table_contains(config_changes, name);
+    g_free(name);
+    return changed;
+}
+
+gboolean
+config_group_changed(const gchar* group)
+{
+    return config_changes && g_hash_table_contains(config_changes, group ? group : CONFIG_GROUP_DEFAULT);
+}
+
+static void
+config_file_changed_cb(GFileMonitor* monitor, GFile* file, GFile* other_file,
+                       GFileMonitorEvent event, gpointer user_data)
+{
+    gchar *name;
+
+    if(event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+        return;
+
+    /* Ignore unrelated files and editor backups */
+    name = g_file_get_basename(file);
+    if(g_str_has_suffix(name, ".conf") || g_strcmp0(name, "lightdm-gtk-greeter.conf.d") == 0)
+    {
+        if(config_reload_id)
+            g_source_remove(config_reload_id);
+        config_reload_id = g_timeout_add(CONFIG_RELOAD_DELAY, config_reload_cb, NULL);
+    }
+    g_free(name);
+}
+
+static gboolean
+config_reload_cb(gpointer user_data)
+{
+    GKeyFile *config;
+
+    config_reload_id = 0;
+
+    config = read_config(FALSE);
+    config_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    diff_config(greeter_config, config, config_changes);
+    diff_config(config, greeter_config, config_changes);
+
+    if(g_hash_table_size(config_changes) == 0)
+    {
+        g_debug("[Configuration] Configuration files changed, values are the same");
+        g_key_file_unref(config);
+    }
+    else
+    {
+        g_message("[Configuration] Configuration reloaded");
+        g_key_file_unref(greeter_config);
+        greeter_config = config;
+        compile_values();
+
+        if(config_reloaded_func)
+            config_reloaded_func(config_reloaded_data);
+    }
+
+    g_clear_pointer(&config_changes, g_hash_table_unref);
+    return G_SOURCE_REMOVE;
+}
+
+/* Adds keys of config that are missing or have other values in other */
+static void
+diff_config(GKeyFile* config, GKeyFile* other, GHashTable* changes)
+{
+    gchar **groups = g_key_file_get_groups(config, NULL);
+    gchar **group_iter;
+
+    for(group_iter = groups; *group_iter; ++group_iter)
+    {
+        gchar **keys = g_key_file_get_keys(config, *group_iter, NULL, NULL);
+        gchar **key_iter;
+
+        for(key_iter = keys; key_iter && *key_iter; ++key_iter)
+        {
+            gchar *value = g_key_file_get_value(config, *group_iter, *key_iter, NULL);
+            gchar *other_value = g_key_file_get_value(other, *group_iter, *key_iter, NULL);
+
+            if(g_strcmp0(value, other_value) != 0)
+            {
+                g_debug("[Configuration] Changed: [%s] %s", *group_iter, *key_iter);
+                g_hash_table_add(changes, g_strdup_printf("%s\n%s", *group_iter, *key_iter));
+                g_hash_table_add(changes, g_strdup(*group_iter));
+            }
+            g_free(value);
+            g_free(other_value);
+        }
+        g_strfreev(keys);
+    }
+    g_strfreev(groups);
+}
+
+const gchar*
+config_get_cache_dir(void)
+{
+    return cache_dir;
 }
 
 static GKeyFile*
@@ -197,29 +807,109 @@ get_file_for_group(const gchar** group)
     return greeter_config;
 }
 
+void
+config_flush_state(void)
+{
+    StateSnapshot* snapshot;
+
+    if(state_save_id)
+    {
+        g_source_remove(state_save_id);
+        state_save_id = 0;
+    }
+
+    /* Nothing is changed since last snapshot and it is already on disk */
+    g_mutex_lock(&state_write_lock);
+    if(!state_changes && state_written_generation >= state_generation)
+    {
+        g_mutex_unlock(&state_write_lock);
+        return;
+    }
+    g_mutex_unlock(&state_write_lock);
+
+    /* Queued snapshots are older, writer thread will skip them */
+    snapshot = state_snapshot_new();
+    state_snapshot_write(snapshot);
+    state_snapshot_free(snapshot);
+}
+
 static void
-save_key_file(GKeyFile* config, const gchar* path)
+schedule_state_save(void)
+{
+    state_changes++;
+    if(state_save_id)
+        g_source_remove(state_save_id);
+    state_save_id = g_timeout_add(STATE_SAVE_DELAY, state_save_cb, NULL);
+}
+
+static gboolean
+state_save_cb(gpointer user_data)
 {
     GError* error = NULL;
-    gsize data_length = 0;
-    gchar* data = g_key_file_to_data(config, &data_length, &error);
 
-    if(error)
+    state_save_id = 0;
+
+    if(!state_writer)
+        state_writer = g_thread_pool_new((GFunc)state_writer_thread, NULL, 1, FALSE, &error);
+
+    if(state_writer)
+        g_thread_pool_push(state_writer, state_snapshot_new(), NULL);
+    else
     {
-        g_warning("[Configuration] Failed to save file: %s", error->message);
+        g_warning("[Configuration] Failed to start state writer, saving synchronously: %s",
+                  error ? error->message : "unknown error");
         g_clear_error(&error);
+        config_flush_state();
     }
+    return G_SOURCE_REMOVE;
+}
 
-    if(data)
+/* Must be called from main thread: state_config is not thread-safe */
+static StateSnapshot*
+state_snapshot_new(void)
+{
+    StateSnapshot* snapshot = g_new0(StateSnapshot, 1);
+
+    snapshot->generation = ++state_generation;
+    snapshot->data = g_key_file_to_data(state_config, &snapshot->length, NULL);
+
+    if(state_changes > 1)
+        g_debug("[Configuration] %u state changes saved at once", state_changes);
+    state_changes = 0;
+
+    return snapshot;
+}
+
+static void
+state_snapshot_free(StateSnapshot* snapshot)
+{
+    g_free(snapshot->data);
+    g_free(snapshot);
+}
+
+static void
+state_snapshot_write(StateSnapshot* snapshot)
+{
+    GError* error = NULL;
+
+    g_mutex_lock(&state_write_lock);
+    if(snapshot->data && snapshot->generation > state_written_generation)
     {
-        g_file_set_contents(path, data, data_length, &error);
-        if(error)
+        if(!g_file_set_contents(state_filename, snapshot->data, snapshot->length, &error))
         {
             g_warning("[Configuration] Failed to save file: %s", error->message);
             g_clear_error(&error);
         }
-        g_free(data);
+        state_written_generation = snapshot->generation;
     }
+    g_mutex_unlock(&state_write_lock);
+}
+
+static void
+state_writer_thread(StateSnapshot* snapshot, gpointer user_data)
+{
+    state_snapshot_write(snapshot);
+    state_snapshot_free(snapshot);
 }
 
 static gboolean
@@ -297,7 +987,7 @@ config_set_string(const gchar* group, const gchar* key, const gchar* value)
     }
 
     g_key_file_set_value(state_config, group, key, value);
-    save_key_file(state_config, state_filename);
+    schedule_state_save();
 }
 
 gchar**
@@ -328,7 +1018,7 @@ config_set_int(const gchar* group, const gchar* key, gint value)
     }
 
     g_key_file_set_integer(state_config, group, key, value);
-    save_key_file(state_config, state_filename);
+    schedule_state_save();
 }
 
 gboolean
@@ -351,7 +1041,7 @@ config_set_bool(const gchar* group, const gchar* key, gboolean value)
     }
 
     g_key_file_set_boolean(state_config, group, key, value);
-    save_key_file(state_config, state_filename);
+    schedule_state_save();
 }
 
 gint
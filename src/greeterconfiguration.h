@@ -37,11 +37,17 @@
 #define CONFIG_KEY_READER               "reader"
 #define CONFIG_KEY_CLOCK_FORMAT         "clock-format"
 #define CONFIG_KEY_ACTIVE_MONITOR       "active-monitor"
+#define CONFIG_KEY_ACTIVE_MONITOR_WINDOW "active-monitor-window"
 #define CONFIG_KEY_POSITION             "position"
 #define CONFIG_KEY_PANEL_POSITION       "panel-position"
 #define CONFIG_KEY_KEYBOARD_POSITION    "keyboard-position"
 #define CONFIG_KEY_A11Y_STATES          "a11y-states"
 #define CONFIG_KEY_AT_SPI_ENABLED       "at-spi-enabled"
+#define CONFIG_KEY_BACKGROUND_DISK_CACHE "background-disk-cache"
+#define CONFIG_KEY_BACKGROUND_SCALER    "background-scaler"
+#define CONFIG_KEY_BACKGROUND_CACHE_MB  "background-cache-mb"
+#define CONFIG_KEY_MONITORS_SETTLE_DELAY "monitors-settle-delay"
+#define CONFIG_KEY_PAINT_STATS          "paint-stats"
 
 #define CONFIG_GROUP_MONITOR            "monitor:"
 #define CONFIG_KEY_BACKGROUND           "background"
@@ -49,14 +55,52 @@
 #define CONFIG_KEY_LAPTOP               "laptop"
 #define CONFIG_KEY_T_TYPE               "transition-type"
 #define CONFIG_KEY_T_DURATION           "transition-duration"
+#define CONFIG_KEY_BACKGROUND_BLUR      "background-blur"
+#define CONFIG_KEY_BACKGROUND_DIM       "background-dim"
+
+/* Values of [greeter] keys parsed once by config_init(): X(field, key, type, fallback) */
+#define CONFIG_TYPED_KEYS(X) \
+    X(allow_debugging,          CONFIG_KEY_DEBUGGING,               BOOL,   FALSE) \
+    X(screensaver_timeout,      CONFIG_KEY_SCREENSAVER_TIMEOUT,     INT,    60) \
+    X(cursor_theme_size,        CONFIG_KEY_CURSOR_THEME_SIZE,       INT,    16) \
+    X(xft_dpi,                  CONFIG_KEY_DPI,                     INT,    96) \
+    X(xft_antialias,            CONFIG_KEY_ANTIALIAS,               BOOL,   FALSE) \
+    X(hide_user_image,          CONFIG_KEY_HIDE_USER_IMAGE,         BOOL,   FALSE) \
+    X(round_user_image,         CONFIG_KEY_ROUND_USER_IMAGE,        BOOL,   TRUE) \
+    X(highlight_logged_user,    CONFIG_KEY_HIGHLIGHT_LOGGED_USER,   BOOL,   TRUE) \
+    X(at_spi_enabled,           CONFIG_KEY_AT_SPI_ENABLED,          BOOL,   TRUE) \
+    X(background_disk_cache,    CONFIG_KEY_BACKGROUND_DISK_CACHE,   INT,    64) \
+    X(background_cache_mb,      CONFIG_KEY_BACKGROUND_CACHE_MB,     INT,    128) \
+    X(monitors_settle_delay,    CONFIG_KEY_MONITORS_SETTLE_DELAY,   INT,    300) \
+    X(paint_stats,              CONFIG_KEY_PAINT_STATS,             BOOL,   FALSE)
+
+#define CONFIG_TYPE_BOOL                gboolean
+#define CONFIG_TYPE_INT                 gint
+
+typedef struct
+{
+#define CONFIG_DECLARE_FIELD(field, key, type, fallback) CONFIG_TYPE_##type field;
+    CONFIG_TYPED_KEYS(CONFIG_DECLARE_FIELD)
+#undef CONFIG_DECLARE_FIELD
+} ConfigValues;
 
 #define STATE_SECTION_GREETER           "/greeter"
 #define STATE_SECTION_A11Y              "/a11y-states"
 #define STATE_KEY_LAST_USER             "last-user"
 #define STATE_KEY_LAST_SESSION          "last-session"
 
+/* Called after configuration files are changed and merged again, see config_key_changed() */
+typedef void (*ConfigReloadedFunc) (gpointer user_data);
 
 void config_init                (void);
+/* Loads configuration bypassing cache, prints merged values with their files and timings */
+void config_dump                (void);
+const gchar* config_get_cache_dir (void);
+void config_flush_state         (void);
+const ConfigValues* config_get_values (void);
+void config_watch               (ConfigReloadedFunc callback, gpointer user_data);
+gboolean config_key_changed     (const gchar* group, const gchar* key);
+gboolean config_group_changed   (const gchar* group);
 
 gchar** config_get_groups       (const gchar* prefix);
 gboolean config_has_key         (const gchar* group, const gchar* key);
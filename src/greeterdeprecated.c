@@ -101,6 +101,14 @@ greeter_screen_get_primary_monitor (GdkScreen *screen)
   return gdk_screen_get_primary_monitor (screen);
 }
 
+gint
+greeter_screen_get_monitor_scale_factor (GdkScreen *screen,
+                                         gint       monitor_num)
+{
+  /* Deprecated GTK 3.22 */
+  return gdk_screen_get_monitor_scale_factor (screen, monitor_num);
+}
+
 void
 greeter_widget_reparent (GtkWidget *widget,
                          GtkWidget *new_parent)
@@ -123,4 +131,12 @@ greeter_device_manager_get_client_pointer (GdkDeviceManager *device_manager)
   return gdk_device_manager_get_client_pointer (device_manager);
 }
 
+void
+greeter_window_set_background_pattern (GdkWindow       *window,
+                                       cairo_pattern_t *pattern)
+{
+  /* Deprecated GTK 3.22 */
+  gdk_window_set_background_pattern (window, pattern);
+}
+
 G_GNUC_END_IGNORE_DEPRECATIONS
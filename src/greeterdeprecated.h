@@ -40,6 +40,9 @@ void                  greeter_screen_get_monitor_geometry         (GdkScreen
 
 gint                  greeter_screen_get_primary_monitor          (GdkScreen        *screen);
 
+gint                  greeter_screen_get_monitor_scale_factor     (GdkScreen        *screen,
+                                                                   gint              monitor_num);
+
 void                  greeter_widget_reparent                     (GtkWidget        *widget,
                                                                    GtkWidget        *new_parent);
 
@@ -47,4 +50,7 @@ GdkDeviceManager *    greeter_display_get_device_manager          (GdkDisplay
 
 GdkDevice *           greeter_device_manager_get_client_pointer   (GdkDeviceManager *device_manager);
 
+void                  greeter_window_set_background_pattern       (GdkWindow        *window,
+                                                                   cairo_pattern_t  *pattern);
+
 #endif //GREETER_DEPRECATED_H
@@ -227,7 +227,7 @@ greeter_get_user_image (const gchar *username)
         image = get_default_user_image ();
     }
 
-    if (image && config_get_bool (NULL, CONFIG_KEY_ROUND_USER_IMAGE, TRUE))
+    if (image && config_get_values ()->round_user_image)
     {
         temp_image = round_image (image);
         if (temp_image != NULL)
@@ -237,7 +237,7 @@ greeter_get_user_image (const gchar *username)
         }
     }
 
-    if (image && logged_in && config_get_bool (NULL, CONFIG_KEY_HIGHLIGHT_LOGGED_USER, TRUE))
+    if (image && logged_in && config_get_values ()->highlight_logged_user)
     {
         temp_image = logged_in_pixbuf (image);
         if (temp_image != NULL)
@@ -209,6 +209,8 @@ static int timeout, interval, prefer_blanking, allow_exposures;
 
 /* Handling monitors backgrounds */
 static const gint USER_BACKGROUND_DELAY = 250;
+/* Number of users on each side of selected one with prefetched backgrounds */
+static const gint USER_BACKGROUND_PREFETCH = 2;
 static GreeterBackground *greeter_background;
 
 /* Authentication state */
@@ -309,6 +311,17 @@ void restart_cb (GtkWidget *widget, LightDMGreeter *greeter);
 void shutdown_cb (GtkWidget *widget, LightDMGreeter *greeter);
 
 static void read_monitor_configuration (const gchar *group, const gchar *name);
+static void read_monitors_configuration (void);
+static const gchar *get_monitor_group_name (const gchar *group);
+/* Groups of monitors configuration, used to detect removed groups on configuration reload */
+static gchar **monitor_config_groups = NULL;
+
+/* Configuration reload */
+static void config_reloaded_cb (gpointer user_data);
+static void reset_gtk_setting (const gchar *property);
+static void reload_gtk_setting (const gchar *key, const gchar *property, const gchar *fallback,
+                                gchar **default_value, gboolean apply);
+static gboolean reload_window_position (const gchar *key, GtkWidget *widget, const WindowPosition *default_value);
 
 struct SavedFocusData
 {
@@ -336,10 +349,221 @@ read_monitor_configuration (const gchar *group, const gchar *name)
                                                 TRANSITION_TYPE_FALLBACK,
                                                 "none",         TRANSITION_TYPE_NONE,
                                                 "linear",       TRANSITION_TYPE_LINEAR,
-                                                "ease-in-out",  TRANSITION_TYPE_EASE_IN_OUT, NULL));
+                                                "ease-in-out",  TRANSITION_TYPE_EASE_IN_OUT, NULL),
+                                           config_get_int (group, CONFIG_KEY_BACKGROUND_BLUR, -1),
+                                           config_get_int (group, CONFIG_KEY_BACKGROUND_DIM, -1));
     g_free (background);
 }
 
+static const gchar*
+get_monitor_group_name (const gchar *group)
+{
+    const gchar *name = group + sizeof (CONFIG_GROUP_MONITOR);
+    while (*name && g_ascii_isspace (*name))
+        ++name;
+    return name;
+}
+
+static void
+read_monitors_configuration (void)
+{
+    gchar **config_group;
+
+    read_monitor_configuration (CONFIG_GROUP_DEFAULT, GREETER_BACKGROUND_DEFAULT);
+
+    g_strfreev (monitor_config_groups);
+    monitor_config_groups = config_get_groups (CONFIG_GROUP_MONITOR);
+    for (config_group = monitor_config_groups; *config_group; ++config_group)
+        read_monitor_configuration (*config_group, get_monitor_group_name (*config_group));
+}
+
+/* Configuration reload */
+
+static void
+reset_gtk_setting (const gchar *property)
+{
+#if GTK_CHECK_VERSION (3, 20, 0)
+    gtk_settings_reset_property (gtk_settings_get_default (), property);
+#else
+    g_message ("[Configuration] Resetting %s requires GTK 3.20, previous value is kept until greeter restart", property);
+#endif
+}
+
+static void
+reload_gtk_setting (const gchar *key, const gchar *property, const gchar *fallback,
+                    gchar **default_value, gboolean apply)
+{
+    gchar *value;
+
+    if (!config_key_changed (NULL, key))
+        return;
+
+    value = config_get_string (NULL, key, fallback);
+    if (!value)
+    {
+        /* Key was removed: drop our override, GTK picks up XSettings or its own default */
+        g_debug ("[Configuration] Resetting %s", property);
+        if (apply)
+            reset_gtk_setting (property);
+        if (default_value)
+        {
+            g_free (*default_value);
+            *default_value = NULL;
+            /* NULL default is reset when a11y override is turned off */
+            if (apply)
+                g_object_get (gtk_settings_get_default (), property, default_value, NULL);
+        }
+        return;
+    }
+
+    g_debug ("[Configuration] Changing %s to '%s'", property, value);
+    if (apply)
+        g_object_set (gtk_settings_get_default (), property, value, NULL);
+    if (default_value)
+    {
+        g_free (*default_value);
+        *default_value = value;
+    }
+    else
+        g_free (value);
+}
+
+static gboolean
+reload_window_position (const gchar *key, GtkWidget *widget, const WindowPosition *default_value)
+{
+    gchar *value;
+
+    if (!config_key_changed (NULL, key))
+        return FALSE;
+
+    value = config_get_string (NULL, key, NULL);
+    g_object_set_data_full (G_OBJECT (widget), WINDOW_DATA_POSITION, str_to_position (value, default_value), g_free);
+    g_free (value);
+    return TRUE;
+}
+
+static void
+config_reloaded_cb (gpointer user_data)
+{
+    static const gchar *BACKGROUND_KEYS[] = {CONFIG_KEY_BACKGROUND, CONFIG_KEY_USER_BACKGROUND, CONFIG_KEY_LAPTOP,
+                                             CONFIG_KEY_T_DURATION, CONFIG_KEY_T_TYPE,
+                                             CONFIG_KEY_BACKGROUND_BLUR, CONFIG_KEY_BACKGROUND_DIM, NULL};
+    static const gchar *RESTART_KEYS[] = {CONFIG_KEY_INDICATORS, CONFIG_KEY_ACTIVE_MONITOR_WINDOW,
+                                          CONFIG_KEY_BACKGROUND_DISK_CACHE, CONFIG_KEY_KEYBOARD,
+                                          CONFIG_KEY_READER, CONFIG_KEY_A11Y_STATES, CONFIG_KEY_HIDE_USER_IMAGE,
+                                          CONFIG_KEY_DEBUGGING, CONFIG_KEY_AT_SPI_ENABLED, NULL};
+    const ConfigValues  *values = config_get_values ();
+    gboolean             high_contrast = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (contrast_menuitem));
+    gboolean             large_font = gtk_check_menu_item_get_active (GTK_CHECK_MENU_ITEM (font_menuitem));
+    gboolean             reload_backgrounds = FALSE;
+    gboolean             reposition = FALSE;
+    gchar              **config_group;
+    const gchar        **key;
+    gchar               *value;
+
+    /* GTK settings, a11y overrides are kept until a11y option is disabled */
+    reload_gtk_setting (CONFIG_KEY_THEME, "gtk-theme-name", NULL, &default_theme_name, !high_contrast);
+    reload_gtk_setting (CONFIG_KEY_ICON_THEME, "gtk-icon-theme-name", NULL, &default_icon_theme_name, !high_contrast);
+    reload_gtk_setting (CONFIG_KEY_CURSOR_THEME, "gtk-cursor-theme-name", NULL, &default_cursor_theme_name, TRUE);
+    reload_gtk_setting (CONFIG_KEY_FONT, "gtk-font-name", "Sans 10", &default_font_name, !large_font);
+    reload_gtk_setting (CONFIG_KEY_HINT_STYLE, "gtk-xft-hintstyle", NULL, NULL, TRUE);
+    reload_gtk_setting (CONFIG_KEY_RGBA, "gtk-xft-rgba", NULL, NULL, TRUE);
+
+    if (config_key_changed (NULL, CONFIG_KEY_CURSOR_THEME_SIZE))
+    {
+        if (config_has_key (NULL, CONFIG_KEY_CURSOR_THEME_SIZE))
+            g_object_set (gtk_settings_get_default (), "gtk-cursor-theme-size", values->cursor_theme_size, NULL);
+        else
+            reset_gtk_setting ("gtk-cursor-theme-size");
+    }
+    if (config_key_changed (NULL, CONFIG_KEY_DPI))
+    {
+        if (config_has_key (NULL, CONFIG_KEY_DPI))
+            g_object_set (gtk_settings_get_default (), "gtk-xft-dpi", 1024*values->xft_dpi, NULL);
+        else
+            reset_gtk_setting ("gtk-xft-dpi");
+    }
+    if (config_key_changed (NULL, CONFIG_KEY_ANTIALIAS))
+    {
+        if (config_has_key (NULL, CONFIG_KEY_ANTIALIAS))
+            g_object_set (gtk_settings_get_default (), "gtk-xft-antialias", values->xft_antialias, NULL);
+        else
+            reset_gtk_setting ("gtk-xft-antialias");
+    }
+
+    /* Screensaver settings are only changed for lock screen, see main() */
+    if (config_key_changed (NULL, CONFIG_KEY_SCREENSAVER_TIMEOUT) && lightdm_greeter_get_lock_hint (greeter))
+        XSetScreenSaver (gdk_x11_display_get_xdisplay (gdk_display_get_default ()), values->screensaver_timeout, 0,
+                         ScreenSaverActive, DefaultExposures);
+
+    /* Clock */
+    if (clock_label && config_key_changed (NULL, CONFIG_KEY_CLOCK_FORMAT))
+    {
+        g_free (clock_format);
+        clock_format = config_get_string (NULL, CONFIG_KEY_CLOCK_FORMAT, "%a, %H:%M");
+        clock_timeout_thread ();
+    }
+
+    /* Windows positions */
+    reposition |= reload_window_position (CONFIG_KEY_POSITION, login_window, &WINDOW_POS_CENTER);
+    if (a11y_keyboard_command)
+        reposition |= reload_window_position (CONFIG_KEY_KEYBOARD_POSITION, a11y_keyboard_command->widget, &KEYBOARD_POSITION);
+    if (config_key_changed (NULL, CONFIG_KEY_PANEL_POSITION))
+    {
+        gtk_widget_set_valign (panel_window, config_get_enum (NULL, CONFIG_KEY_PANEL_POSITION, GTK_ALIGN_START,
+                                                              "bottom", GTK_ALIGN_END,
+                                                              "top", GTK_ALIGN_START, NULL));
+        reposition = TRUE;
+    }
+    if (reposition)
+        gtk_widget_queue_resize (GTK_WIDGET (screen_overlay));
+
+    /* Background */
+    if (config_key_changed (NULL, CONFIG_KEY_ACTIVE_MONITOR))
+    {
+        value = config_get_string (NULL, CONFIG_KEY_ACTIVE_MONITOR, NULL);
+        greeter_background_set_active_monitor_config (greeter_background, value ? value : "#cursor");
+        g_free (value);
+    }
+
+    greeter_background_set_paint_stats (greeter_background, values->paint_stats);
+    greeter_background_set_monitors_settle_delay (greeter_background, values->monitors_settle_delay);
+    greeter_background_set_cache_size (greeter_background, values->background_cache_mb);
+    if (config_key_changed (NULL, CONFIG_KEY_BACKGROUND_SCALER))
+        greeter_background_set_scaler (greeter_background,
+                                       config_get_enum (NULL, CONFIG_KEY_BACKGROUND_SCALER,
+                                            BACKGROUND_SCALER_BILINEAR,
+                                            "bilinear",     BACKGROUND_SCALER_BILINEAR,
+                                            "hyper",        BACKGROUND_SCALER_HYPER,
+                                            "single",       BACKGROUND_SCALER_SINGLE,
+                                            "render",       BACKGROUND_SCALER_RENDER, NULL));
+
+    for (key = BACKGROUND_KEYS; *key && !reload_backgrounds; ++key)
+        reload_backgrounds = config_key_changed (NULL, *key);
+    for (config_group = monitor_config_groups; *config_group && !reload_backgrounds; ++config_group)
+        reload_backgrounds = config_group_changed (*config_group);
+    if (!reload_backgrounds)
+    {
+        gchar **groups = config_get_groups (CONFIG_GROUP_MONITOR);
+        for (config_group = groups; *config_group && !reload_backgrounds; ++config_group)
+            reload_backgrounds = config_group_changed (*config_group);
+        g_strfreev (groups);
+    }
+
+    if (reload_backgrounds)
+    {
+        /* Monitors with unchanged configuration keep their windows and backgrounds */
+        for (config_group = monitor_config_groups; *config_group; ++config_group)
+            greeter_background_remove_monitor_config (greeter_background, get_monitor_group_name (*config_group));
+        read_monitors_configuration ();
+        greeter_background_connect (greeter_background, gdk_screen_get_default ());
+    }
+
+    for (key = RESTART_KEYS; *key; ++key)
+        if (config_key_changed (NULL, *key))
+            g_message ("[Configuration] Changes of '%s' will be applied after greeter restart", *key);
+}
+
 gpointer
 greeter_save_focus(GtkWidget* widget)
 {
@@ -459,6 +683,8 @@ sigterm_cb (gpointer user_data)
     if (is_callback)
         g_debug ("SIGTERM received");
 
+    config_flush_state ();
+
     if (pids_to_close)
     {
         g_slist_foreach (pids_to_close, (GFunc)close_pid, GINT_TO_POINTER (FALSE));
@@ -1990,10 +2216,14 @@ a11y_font_cb (GtkCheckMenuItem *item)
 
         g_object_set (gtk_settings_get_default (), "gtk-font-name", font_name, NULL);
     }
-    else
+    else if (default_font_name)
     {
         g_object_set (gtk_settings_get_default (), "gtk-font-name", default_font_name, NULL);
     }
+    else
+    {
+        reset_gtk_setting ("gtk-font-name");
+    }
 }
 
 void
@@ -2006,8 +2236,14 @@ a11y_contrast_cb (GtkCheckMenuItem *item)
     }
     else
     {
-        g_object_set (gtk_settings_get_default (), "gtk-theme-name", default_theme_name, NULL);
-        g_object_set (gtk_settings_get_default (), "gtk-icon-theme-name", default_icon_theme_name, NULL);
+        if (default_theme_name)
+            g_object_set (gtk_settings_get_default (), "gtk-theme-name", default_theme_name, NULL);
+        else
+            reset_gtk_setting ("gtk-theme-name");
+        if (default_icon_theme_name)
+            g_object_set (gtk_settings_get_default (), "gtk-icon-theme-name", default_icon_theme_name, NULL);
+        else
+            reset_gtk_setting ("gtk-icon-theme-name");
     }
 }
 
@@ -2089,6 +2325,45 @@ set_login_button_label (LightDMGreeter *ldm, const gchar *username)
 }
 
 static guint set_user_background_delayed_id = 0;
+static guint prefetch_user_backgrounds_id = 0;
+
+static gboolean
+prefetch_user_backgrounds_cb (gpointer user_data)
+{
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gint active, count, offset;
+
+    prefetch_user_backgrounds_id = 0;
+
+    model = gtk_combo_box_get_model (user_combo);
+    active = gtk_combo_box_get_active (user_combo);
+    count = gtk_tree_model_iter_n_children (model, NULL);
+    /* Neighbours of previous selection are not needed anymore */
+    greeter_background_cancel_prefetch (greeter_background);
+
+    if (active < 0)
+        return G_SOURCE_REMOVE;
+
+    /* Nearest users first: next, previous, second next... */
+    for (offset = 1; offset <= USER_BACKGROUND_PREFETCH * 2; ++offset)
+    {
+        gint row = active + (offset % 2 ? 1 : -1) * ((offset + 1) / 2);
+        gchar *name;
+        LightDMUser *user;
+
+        if (row < 0 || row >= count || !gtk_tree_model_iter_nth_child (model, &iter, NULL, row))
+            continue;
+
+        gtk_tree_model_get (model, &iter, 0, &name, -1);
+        user = lightdm_user_list_get_user_by_name (lightdm_user_list_get_instance (), name);
+        if (user && lightdm_user_get_background (user))
+            greeter_background_prefetch (greeter_background, lightdm_user_get_background (user));
+        g_free (name);
+    }
+
+    return G_SOURCE_REMOVE;
+}
 
 static gboolean
 set_user_background_delayed_cb (const gchar *value)
@@ -2117,13 +2392,18 @@ set_user_background (const gchar *user_name)
 
     if (!value)
         greeter_background_set_custom_background (greeter_background, NULL);
+    else if (greeter_background_is_custom_background_cached (greeter_background, value))
+        greeter_background_set_custom_background (greeter_background, value);
     else
     {
-        /* Small delay before changing background */
+        /* Small delay before changing background, if it is not ready yet */
         set_user_background_delayed_id = g_timeout_add_full (G_PRIORITY_DEFAULT, USER_BACKGROUND_DELAY,
                                                              (GSourceFunc)set_user_background_delayed_cb,
                                                              g_strdup (value), g_free);
     }
+
+    if (!prefetch_user_backgrounds_id)
+        prefetch_user_backgrounds_id = g_idle_add_full (G_PRIORITY_LOW, prefetch_user_backgrounds_cb, NULL, NULL);
 }
 
 static void
@@ -2266,6 +2546,8 @@ start_session (void)
 
     /* Remember last choice */
     config_set_string (STATE_SECTION_GREETER, STATE_KEY_LAST_SESSION, session);
+    /* Session can replace greeter at any moment */
+    config_flush_state ();
 
     greeter_background_save_xroot (greeter_background);
 
@@ -2880,8 +3162,6 @@ main (int argc, char **argv)
     const GList     *item;
     GList           *menubar_items;
 
-    gchar          **config_groups;
-    gchar          **config_group;
     gchar          **a11y_states;
 
     gchar           *value;
@@ -2916,6 +3196,13 @@ main (int argc, char **argv)
 
     /*mlockall (MCL_CURRENT | MCL_FUTURE);*/
 
+    /* Audit mode: neither X nor lightdm are used */
+    if (argc > 1 && g_strcmp0 (argv[1], "--dump-config") == 0)
+    {
+        config_dump ();
+        return EXIT_SUCCESS;
+    }
+
     g_message ("Starting %s (%s, %s)", PACKAGE_STRING, __DATE__, __TIME__);
 
     /* Disable global menus */
@@ -2934,7 +3221,7 @@ main (int argc, char **argv)
 
     config_init ();
 
-    if (config_get_bool (NULL, CONFIG_KEY_DEBUGGING, FALSE))
+    if (config_get_values ()->allow_debugging)
         g_log_set_default_handler (debug_log_handler, NULL);
 
     /* init gtk */
@@ -2943,7 +3230,7 @@ main (int argc, char **argv)
     /* Disabling GtkInspector shortcuts.
        It is still possible to run GtkInspector with GTK_DEBUG=interactive.
        Assume that user knows what he's doing. */
-    if (!config_get_bool (NULL, CONFIG_KEY_DEBUGGING, FALSE))
+    if (!config_get_values ()->allow_debugging)
     {
         GtkWidget *fake_window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
         GtkBindingSet *set = gtk_binding_set_by_class (G_OBJECT_GET_CLASS (fake_window));
@@ -2996,7 +3283,7 @@ main (int argc, char **argv)
         Display *display = gdk_x11_display_get_xdisplay (gdk_display_get_default ());
         XGetScreenSaver (display, &timeout, &interval, &prefer_blanking, &allow_exposures);
         XForceScreenSaver (display, ScreenSaverActive);
-        XSetScreenSaver (display, config_get_int (NULL, CONFIG_KEY_SCREENSAVER_TIMEOUT, 60), 0,
+        XSetScreenSaver (display, config_get_values ()->screensaver_timeout, 0,
                          ScreenSaverActive, DefaultExposures);
     }
 
@@ -3033,7 +3320,7 @@ main (int argc, char **argv)
 
     if (config_has_key(NULL, CONFIG_KEY_CURSOR_THEME_SIZE))
     {
-        g_object_set (gtk_settings_get_default (), "gtk-cursor-theme-size", config_get_int (NULL, CONFIG_KEY_CURSOR_THEME_SIZE, 16), NULL);
+        g_object_set (gtk_settings_get_default (), "gtk-cursor-theme-size", config_get_values ()->cursor_theme_size, NULL);
     }
 
     value = config_get_string (NULL, CONFIG_KEY_FONT, "Sans 10");
@@ -3047,10 +3334,10 @@ main (int argc, char **argv)
     g_debug ("[Configuration] Font: '%s'", default_font_name);
 
     if (config_has_key (NULL, CONFIG_KEY_DPI))
-        g_object_set (gtk_settings_get_default (), "gtk-xft-dpi", 1024*config_get_int (NULL, CONFIG_KEY_DPI, 96), NULL);
+        g_object_set (gtk_settings_get_default (), "gtk-xft-dpi", 1024*config_get_values ()->xft_dpi, NULL);
 
     if (config_has_key (NULL, CONFIG_KEY_ANTIALIAS))
-        g_object_set (gtk_settings_get_default (), "gtk-xft-antialias", config_get_bool (NULL, CONFIG_KEY_ANTIALIAS, FALSE), NULL);
+        g_object_set (gtk_settings_get_default (), "gtk-xft-antialias", config_get_values ()->xft_antialias, NULL);
 
     value = config_get_string (NULL, CONFIG_KEY_HINT_STYLE, NULL);
     if (value)
@@ -3067,7 +3354,7 @@ main (int argc, char **argv)
     }
 
     #ifdef AT_SPI_COMMAND
-    if (config_has_key (NULL, CONFIG_KEY_AT_SPI_ENABLED) && config_get_bool (NULL, CONFIG_KEY_AT_SPI_ENABLED, TRUE) == FALSE)
+    if (!config_get_values ()->at_spi_enabled)
     {
         // AT_SPI is user-disabled
     }
@@ -3162,7 +3449,7 @@ main (int argc, char **argv)
     else
         g_list_free (menubar_items);
 
-    if (config_get_bool (NULL, CONFIG_KEY_HIDE_USER_IMAGE, FALSE))
+    if (config_get_values ()->hide_user_image)
     {
         gtk_widget_hide (GTK_WIDGET (gtk_builder_get_object (builder, "user_image_border")));
         gtk_widget_hide (GTK_WIDGET (user_image));  /* Hide to mark image is disabled */
@@ -3349,18 +3636,28 @@ main (int argc, char **argv)
     greeter_background_set_active_monitor_config (greeter_background, value ? value : "#cursor");
     g_free (value);
 
-    read_monitor_configuration (CONFIG_GROUP_DEFAULT, GREETER_BACKGROUND_DEFAULT);
-
-    config_groups = config_get_groups (CONFIG_GROUP_MONITOR);
-    for (config_group = config_groups; *config_group; ++config_group)
-    {
-        const gchar *name = *config_group + sizeof (CONFIG_GROUP_MONITOR);
-        while (*name && g_ascii_isspace (*name))
-            ++name;
-
-        read_monitor_configuration (*config_group, name);
-    }
-    g_strfreev (config_groups);
+    greeter_background_set_separate_window (greeter_background,
+                                            config_get_enum (NULL, CONFIG_KEY_ACTIVE_MONITOR_WINDOW, FALSE,
+                                                 "reparent",    FALSE,
+                                                 "move",        TRUE, NULL));
+
+    greeter_background_set_paint_stats (greeter_background,
+                                        config_get_values ()->paint_stats);
+    greeter_background_set_monitors_settle_delay (greeter_background,
+                                                  config_get_values ()->monitors_settle_delay);
+    greeter_background_set_cache_size (greeter_background,
+                                       config_get_values ()->background_cache_mb);
+    greeter_background_set_disk_cache (greeter_background, config_get_cache_dir (),
+                                       config_get_values ()->background_disk_cache);
+    greeter_background_set_scaler (greeter_background,
+                                   config_get_enum (NULL, CONFIG_KEY_BACKGROUND_SCALER,
+                                        BACKGROUND_SCALER_BILINEAR,
+                                        "bilinear",     BACKGROUND_SCALER_BILINEAR,
+                                        "hyper",        BACKGROUND_SCALER_HYPER,
+                                        "single",       BACKGROUND_SCALER_SINGLE,
+                                        "render",       BACKGROUND_SCALER_RENDER, NULL));
+
+    read_monitors_configuration ();
 
     greeter_background_add_accel_group (greeter_background, GTK_ACCEL_GROUP (gtk_builder_get_object (builder, "a11y_accelgroup")));
     greeter_background_add_accel_group (greeter_background, GTK_ACCEL_GROUP (gtk_builder_get_object (builder, "power_accelgroup")));
@@ -3396,6 +3693,8 @@ main (int argc, char **argv)
         g_free (value);
     }
 
+    config_watch (config_reloaded_cb, NULL);
+
     gtk_builder_connect_signals (builder, greeter);
 
     a11y_states = config_get_string_list (NULL, CONFIG_KEY_A11Y_STATES, NULL);